@@ -141,6 +141,7 @@ static int want_sdp = 1;
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *benchmark_stages_avio = NULL;
 
 static uint8_t *subtitle_out;
 
@@ -166,6 +167,7 @@ static int restore_tty;
 
 #if HAVE_THREADS
 static void free_input_threads(void);
+static void free_encoder_threads(void);
 #endif
 
 /* sub2video hack:
@@ -489,8 +491,15 @@ static void ffmpeg_cleanup(int ret)
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
     }
 
+#if HAVE_THREADS
+    free_encoder_threads();
+#endif
+
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
+#if HAVE_THREADS
+        free_filtergraph_thread(fg);
+#endif
         avfilter_graph_free(&fg->graph);
         for (j = 0; j < fg->nb_inputs; j++) {
             while (av_fifo_size(fg->inputs[j]->frame_queue)) {
@@ -614,6 +623,7 @@ static void ffmpeg_cleanup(int ret)
                    av_err2str(AVERROR(errno)));
     }
     av_freep(&vstats_filename);
+    avio_closep(&benchmark_stages_avio);
 
     av_freep(&input_streams);
     av_freep(&input_files);
@@ -678,6 +688,100 @@ static void update_benchmark(const char *fmt, ...)
     }
 }
 
+static int64_t get_thread_cpu_usec(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#elif HAVE_GETPROCESSTIMES
+    FILETIME c, e, k, u;
+
+    if (GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u))
+        return (((int64_t)u.dwHighDateTime << 32 | u.dwLowDateTime) +
+                ((int64_t)k.dwHighDateTime << 32 | k.dwLowDateTime)) / 10;
+#endif
+    return 0;
+}
+
+void stage_timer_start(StageTimer *t)
+{
+    if (!do_benchmark_stages)
+        return;
+    t->real_usec = av_gettime_relative();
+    t->cpu_usec  = get_thread_cpu_usec();
+}
+
+void stage_timer_stop(const StageTimer *t, StageStats *s, int nb)
+{
+    if (!do_benchmark_stages)
+        return;
+    atomic_fetch_add_explicit(&s->nb, nb, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->real_usec, av_gettime_relative() - t->real_usec,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->cpu_usec, get_thread_cpu_usec() - t->cpu_usec,
+                              memory_order_relaxed);
+}
+
+void stage_timer_stop_wait(const StageTimer *t, StageStats *s)
+{
+    if (!do_benchmark_stages)
+        return;
+    atomic_fetch_add_explicit(&s->wait_usec, av_gettime_relative() - t->real_usec,
+                              memory_order_relaxed);
+}
+
+#if HAVE_THREADS
+int thread_progress_init(ThreadProgress *p)
+{
+    int ret;
+
+    p->count = 0;
+    if ((ret = pthread_mutex_init(&p->lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&p->cond, NULL))) {
+        pthread_mutex_destroy(&p->lock);
+        return AVERROR(ret);
+    }
+    return 0;
+}
+
+void thread_progress_uninit(ThreadProgress *p)
+{
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+}
+
+unsigned thread_progress_get(ThreadProgress *p)
+{
+    unsigned count;
+
+    pthread_mutex_lock(&p->lock);
+    count = p->count;
+    pthread_mutex_unlock(&p->lock);
+    return count;
+}
+
+void thread_progress_signal(ThreadProgress *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->count++;
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* sleep until the worker made progress since thread_progress_get()
+ * returned count */
+void thread_progress_wait(ThreadProgress *p, unsigned count)
+{
+    pthread_mutex_lock(&p->lock);
+    while (p->count == count)
+        pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+#endif
+
 static void close_all_output_streams(OutputStream *ost, OSTFinished this_stream, OSTFinished others)
 {
     int i;
@@ -691,6 +795,7 @@ static void write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int u
 {
     AVFormatContext *s = of->ctx;
     AVStream *st = ost->st;
+    StageTimer timer;
     int ret;
 
     /*
@@ -813,7 +918,9 @@ static void write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int u
               );
     }
 
+    stage_timer_start(&timer);
     ret = av_interleaved_write_frame(s, pkt);
+    stage_timer_stop(&timer, &ost->mux_stats, 1);
     if (ret < 0) {
         print_error("av_interleaved_write_frame()", ret);
         main_return_code = 1;
@@ -908,11 +1015,270 @@ static int check_recording_time(OutputStream *ost)
     return 1;
 }
 
+static int encoder_thread_running(OutputStream *ost)
+{
+#if HAVE_THREADS
+    return !!ost->enc_frame_queue;
+#else
+    return 0;
+#endif
+}
+
+#if HAVE_THREADS
+static void free_queued_frame(void *msg)
+{
+    av_frame_free(msg);
+}
+
+static void free_queued_packet(void *msg)
+{
+    av_packet_unref(msg);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream   *ost = arg;
+    AVCodecContext *enc = ost->enc_ctx;
+    StageTimer timer;
+    int ret = 0;
+
+    while (ret >= 0) {
+        AVFrame *frame;
+        int64_t pts;
+
+        ret = av_thread_message_queue_recv(ost->enc_frame_queue, &frame, 0);
+        if (ret < 0)
+            break;
+        thread_progress_signal(&ost->enc_progress);
+
+        /* a NULL frame flushes the encoder */
+        pts = frame ? frame->pts : AV_NOPTS_VALUE;
+        if (frame && enc->codec_type == AVMEDIA_TYPE_VIDEO && !ost->frame_aspect_ratio.num)
+            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+        stage_timer_start(&timer);
+        ret = avcodec_send_frame(enc, frame);
+        stage_timer_stop(&timer, &ost->encode_stats, 0);
+        av_frame_free(&frame);
+
+        while (ret >= 0) {
+            AVPacket pkt;
+
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+
+            stage_timer_start(&timer);
+            ret = avcodec_receive_packet(enc, &pkt);
+            stage_timer_stop(&timer, &ost->encode_stats, ret >= 0);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = 0;
+                break;
+            }
+            if (ret < 0)
+                break;
+
+            if (enc->codec_type == AVMEDIA_TYPE_VIDEO && pkt.pts == AV_NOPTS_VALUE &&
+                !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
+                pkt.pts = pts;
+
+            /* if two pass, output log */
+            if (ost->logfile && enc->stats_out)
+                fprintf(ost->logfile, "%s", enc->stats_out);
+
+            ret = av_thread_message_queue_send(ost->enc_packet_queue, &pkt, 0);
+            if (ret < 0)
+                av_packet_unref(&pkt);
+            else
+                thread_progress_signal(&ost->enc_progress);
+        }
+    }
+
+    /* AVERROR_EOF once the encoder has been flushed */
+    av_thread_message_queue_set_err_send(ost->enc_frame_queue, ret);
+    av_thread_message_queue_set_err_recv(ost->enc_packet_queue, ret);
+    thread_progress_signal(&ost->enc_progress);
+
+    return NULL;
+}
+
+static int init_encoder_thread(OutputStream *ost)
+{
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&ost->enc_frame_queue,
+                                        ost->enc_thread_queue_size, sizeof(AVFrame *));
+    if (ret < 0)
+        return ret;
+    ret = av_thread_message_queue_alloc(&ost->enc_packet_queue,
+                                        ost->enc_thread_queue_size, sizeof(AVPacket));
+    if (ret < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(ost->enc_frame_queue, free_queued_frame);
+    av_thread_message_queue_set_free_func(ost->enc_packet_queue, free_queued_packet);
+    if ((ret = thread_progress_init(&ost->enc_progress)) < 0)
+        goto fail;
+
+    if ((ret = pthread_create(&ost->enc_thread, NULL, encoder_thread, ost))) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+        ret = AVERROR(ret);
+        thread_progress_uninit(&ost->enc_progress);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    av_thread_message_queue_free(&ost->enc_frame_queue);
+    av_thread_message_queue_free(&ost->enc_packet_queue);
+    return ret;
+}
+
+static void free_encoder_thread(OutputStream *ost)
+{
+    if (!ost->enc_frame_queue)
+        return;
+
+    /* wake the thread up whether it waits for a frame or for room
+     * to return a packet */
+    av_thread_message_queue_set_err_recv(ost->enc_frame_queue, AVERROR_EOF);
+    av_thread_message_flush(ost->enc_frame_queue);
+    av_thread_message_queue_set_err_send(ost->enc_packet_queue, AVERROR_EOF);
+    av_thread_message_flush(ost->enc_packet_queue);
+
+    pthread_join(ost->enc_thread, NULL);
+    thread_progress_uninit(&ost->enc_progress);
+    av_thread_message_queue_free(&ost->enc_frame_queue);
+    av_thread_message_queue_free(&ost->enc_packet_queue);
+}
+
+static void free_encoder_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i])
+            free_encoder_thread(output_streams[i]);
+}
+
+/**
+ * Mux the packets returned by the encoder thread of ost.
+ *
+ * @param flags 0 to wait until the encoder has been flushed, or
+ *              AV_THREAD_MESSAGE_NONBLOCK to only take the packets
+ *              already available
+ * @return the number of packets, or AVERROR_EOF once the encoder
+ *         has been flushed
+ */
+static int output_encoder_thread_packets(OutputFile *of, OutputStream *ost, int flags)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    AVPacket pkt;
+    StageTimer timer;
+    int ret, nb_packets = 0;
+
+    while (1) {
+        stage_timer_start(&timer);
+        ret = av_thread_message_queue_recv(ost->enc_packet_queue, &pkt, flags);
+        if (!flags)
+            stage_timer_stop_wait(&timer, &ost->encode_stats);
+        if (ret < 0)
+            break;
+
+        if (debug_ts) {
+            av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
+                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+                   av_get_media_type_string(enc->codec_type),
+                   av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &enc->time_base),
+                   av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
+        }
+        nb_packets++;
+
+        if (ost->finished & MUXER_FINISHED) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+        av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
+        output_packet(of, &pkt, ost, 0);
+    }
+
+    if (ret == AVERROR(EAGAIN))
+        return nb_packets;
+    if (ret != AVERROR_EOF) {
+        av_log(NULL, AV_LOG_FATAL, "%s encoding failed: %s\n",
+               av_get_media_type_string(enc->codec_type), av_err2str(ret));
+        exit_program(1);
+    }
+    return ret;
+}
+
+/**
+ * Queue a reference to frame for the encoder thread of ost, or flush the
+ * encoder if frame is NULL. Blocks while the queue is full, muxing the
+ * packets the encoder thread returns in the meantime.
+ */
+static void send_frame_to_encoder_thread(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    AVFrame *ref = NULL;
+    StageTimer timer;
+    int ret;
+
+    if (frame && !(ref = av_frame_clone(frame))) {
+        av_log(NULL, AV_LOG_FATAL, "Could not reference a frame for the encoder thread\n");
+        exit_program(1);
+    }
+
+    /* the encoder thread may itself be waiting for room in the packet
+     * queue, so keep draining it instead of blocking on the frame queue;
+     * when neither queue moved, sleep until the thread takes a frame or
+     * returns a packet */
+    while (1) {
+        unsigned progress = thread_progress_get(&ost->enc_progress);
+
+        ret = av_thread_message_queue_send(ost->enc_frame_queue, &ref,
+                                           AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret != AVERROR(EAGAIN))
+            break;
+        if (!output_encoder_thread_packets(of, ost, AV_THREAD_MESSAGE_NONBLOCK)) {
+            stage_timer_start(&timer);
+            thread_progress_wait(&ost->enc_progress, progress);
+            stage_timer_stop_wait(&timer, &ost->encode_stats);
+        }
+    }
+    if (ret < 0) {
+        /* the encoder thread has stopped, report why */
+        av_frame_free(&ref);
+        output_encoder_thread_packets(of, ost, 0);
+        return;
+    }
+
+    output_encoder_thread_packets(of, ost, AV_THREAD_MESSAGE_NONBLOCK);
+}
+
+static void flush_encoder_thread(OutputFile *of, OutputStream *ost)
+{
+    AVPacket pkt;
+
+    send_frame_to_encoder_thread(of, ost, NULL);
+    output_encoder_thread_packets(of, ost, 0);
+
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    output_packet(of, &pkt, ost, 1);
+
+    pthread_join(ost->enc_thread, NULL);
+    thread_progress_uninit(&ost->enc_progress);
+    av_thread_message_queue_free(&ost->enc_frame_queue);
+    av_thread_message_queue_free(&ost->enc_packet_queue);
+}
+#endif
+
 static void do_audio_out(OutputFile *of, OutputStream *ost,
                          AVFrame *frame)
 {
     AVCodecContext *enc = ost->enc_ctx;
     AVPacket pkt;
+    StageTimer timer;
     int ret;
 
     av_init_packet(&pkt);
@@ -937,12 +1303,23 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                enc->time_base.num, enc->time_base.den);
     }
 
+#if HAVE_THREADS
+    if (ost->enc_frame_queue) {
+        send_frame_to_encoder_thread(of, ost, frame);
+        return;
+    }
+#endif
+
+    stage_timer_start(&timer);
     ret = avcodec_send_frame(enc, frame);
+    stage_timer_stop(&timer, &ost->encode_stats, 0);
     if (ret < 0)
         goto error;
 
     while (1) {
+        stage_timer_start(&timer);
         ret = avcodec_receive_packet(enc, &pkt);
+        stage_timer_stop(&timer, &ost->encode_stats, ret >= 0);
         if (ret == AVERROR(EAGAIN))
             break;
         if (ret < 0)
@@ -976,6 +1353,7 @@ static void do_subtitle_out(OutputFile *of,
     int subtitle_out_size, nb, i;
     AVCodecContext *enc;
     AVPacket pkt;
+    StageTimer timer;
     int64_t pts;
 
     if (sub->pts == AV_NOPTS_VALUE) {
@@ -1024,8 +1402,10 @@ static void do_subtitle_out(OutputFile *of,
 
         ost->frames_encoded++;
 
+        stage_timer_start(&timer);
         subtitle_out_size = avcodec_encode_subtitle(enc, subtitle_out,
                                                     subtitle_out_max_size, sub);
+        stage_timer_stop(&timer, &ost->encode_stats, subtitle_out_size > 0);
         if (i == 1)
             sub->num_rects = save_num_rects;
         if (subtitle_out_size < 0) {
@@ -1058,6 +1438,7 @@ static void do_video_out(OutputFile *of,
 {
     int ret, format_video_sync;
     AVPacket pkt;
+    StageTimer timer;
     AVCodecContext *enc = ost->enc_ctx;
     AVCodecParameters *mux_par = ost->st->codecpar;
     AVRational frame_rate;
@@ -1285,14 +1666,28 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
+#if HAVE_THREADS
+        if (ost->enc_frame_queue) {
+            send_frame_to_encoder_thread(of, ost, in_picture);
+            av_frame_remove_side_data(in_picture, AV_FRAME_DATA_A53_CC);
+            ost->sync_opts++;
+            ost->frame_number++;
+            continue;
+        }
+#endif
+
+        stage_timer_start(&timer);
         ret = avcodec_send_frame(enc, in_picture);
+        stage_timer_stop(&timer, &ost->encode_stats, 0);
         if (ret < 0)
             goto error;
         // Make sure Closed Captions will not be duplicated
         av_frame_remove_side_data(in_picture, AV_FRAME_DATA_A53_CC);
 
         while (1) {
+            stage_timer_start(&timer);
             ret = avcodec_receive_packet(enc, &pkt);
+            stage_timer_stop(&timer, &ost->encode_stats, ret >= 0);
             update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
             if (ret == AVERROR(EAGAIN))
                 break;
@@ -1415,6 +1810,195 @@ static void finish_output_stream(OutputStream *ost)
     }
 }
 
+/**
+ * Send a frame from the buffersink of ost to its encoder.
+ */
+static void encode_filtered_frame(OutputStream *ost, AVFrame *filtered_frame)
+{
+    OutputFile    *of = output_files[ost->file_index];
+    AVFilterContext *filter = ost->filter->filter;
+    AVCodecContext *enc = ost->enc_ctx;
+    double float_pts = AV_NOPTS_VALUE; // this is identical to filtered_frame.pts but with higher precision
+
+    if (filtered_frame->pts != AV_NOPTS_VALUE) {
+        int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
+        AVRational filter_tb = av_buffersink_get_time_base(filter);
+        AVRational tb = enc->time_base;
+        int extra_bits = av_clip(29 - av_log2(tb.den), 0, 16);
+
+        tb.den <<= extra_bits;
+        float_pts =
+            av_rescale_q(filtered_frame->pts, filter_tb, tb) -
+            av_rescale_q(start_time, AV_TIME_BASE_Q, tb);
+        float_pts /= 1 << extra_bits;
+        // avoid exact midoints to reduce the chance of rounding differences, this can be removed in case the fps code is changed to work with integers
+        float_pts += FFSIGN(float_pts) * 1.0 / (1<<17);
+
+        filtered_frame->pts =
+            av_rescale_q(filtered_frame->pts, filter_tb, enc->time_base) -
+            av_rescale_q(start_time, AV_TIME_BASE_Q, enc->time_base);
+    }
+
+    switch (av_buffersink_get_type(filter)) {
+    case AVMEDIA_TYPE_VIDEO:
+        /* the encoder thread does this itself */
+        if (!ost->frame_aspect_ratio.num && !encoder_thread_running(ost))
+            enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
+
+        if (debug_ts) {
+            av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s exact:%f time_base:%d/%d\n",
+                    av_ts2str(filtered_frame->pts), av_ts2timestr(filtered_frame->pts, &enc->time_base),
+                    float_pts,
+                    enc->time_base.num, enc->time_base.den);
+        }
+
+        do_video_out(of, ost, filtered_frame, float_pts);
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        if (!(enc->codec->capabilities & AV_CODEC_CAP_PARAM_CHANGE) &&
+            enc->channels != filtered_frame->channels) {
+            av_log(NULL, AV_LOG_ERROR,
+                   "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
+            break;
+        }
+        do_audio_out(of, ost, filtered_frame);
+        break;
+    default:
+        // TODO support subtitle filters
+        av_assert0(0);
+    }
+}
+
+#if HAVE_THREADS
+/**
+ * Handle the messages from the thread of fg.
+ *
+ * @param flags 0 to wait for at least one message, or
+ *              AV_THREAD_MESSAGE_NONBLOCK
+ * @return the number of messages, or the reason the thread has stopped
+ *         (AVERROR_EOF at the end of the graph) once it has been joined
+ */
+static int reap_filtergraph_thread(FilterGraph *fg, int flags)
+{
+    FilterThreadMessage msg;
+    StageTimer timer;
+    int ret, nb_msgs = 0;
+
+    while (1) {
+        stage_timer_start(&timer);
+        ret = av_thread_message_queue_recv(fg->out_thread_queue, &msg, flags);
+        if (!flags)
+            stage_timer_stop_wait(&timer, &fg->filter_stats);
+        if (ret < 0)
+            break;
+        flags = AV_THREAD_MESSAGE_NONBLOCK;
+        nb_msgs++;
+
+        if (msg.type == FILTER_THREAD_NEED_INPUT) {
+            fg->wanted_input = msg.index;
+        } else {
+            OutputStream *ost = fg->outputs[msg.index]->ost;
+            if (!ost->finished)
+                encode_filtered_frame(ost, msg.frame);
+            av_frame_free(&msg.frame);
+        }
+    }
+    if (ret == AVERROR(EAGAIN))
+        return nb_msgs;
+
+    /* the graph is driven from the main thread again */
+    free_filtergraph_thread(fg);
+    if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+        av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
+    return ret;
+}
+
+/**
+ * Queue a message for the thread of fg. While the queue is full, the
+ * frames returned by the thread are encoded in the meantime.
+ */
+static int send_to_filtergraph_thread(FilterGraph *fg, FilterThreadMessage *msg)
+{
+    StageTimer timer;
+    int ret;
+
+    while (1) {
+        unsigned progress = thread_progress_get(&fg->thread_progress);
+
+        ret = av_thread_message_queue_send(fg->in_thread_queue, msg,
+                                           AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret != AVERROR(EAGAIN))
+            break;
+        ret = reap_filtergraph_thread(fg, AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret < 0)
+            break;
+        /* nothing moved: sleep until the thread takes a message or
+         * returns one */
+        if (!ret) {
+            stage_timer_start(&timer);
+            thread_progress_wait(&fg->thread_progress, progress);
+            stage_timer_stop_wait(&timer, &fg->filter_stats);
+        }
+    }
+    if (ret < 0) {
+        av_frame_free(&msg->frame);
+        return ret;
+    }
+
+    fg->wanted_input = -1;
+    return 0;
+}
+
+static void stop_filtergraph_thread(FilterGraph *fg)
+{
+    FilterThreadMessage msg = { .type = FILTER_THREAD_STOP };
+
+    send_to_filtergraph_thread(fg, &msg);
+    while (fg->in_thread_queue && reap_filtergraph_thread(fg, 0) >= 0)
+        ;
+}
+
+static void stop_filtergraph_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_filtergraphs; i++)
+        if (filtergraphs[i]->in_thread_queue)
+            stop_filtergraph_thread(filtergraphs[i]);
+}
+
+static int start_filtergraph_thread(FilterGraph *fg)
+{
+    int i, ret;
+
+    if (filter_thread_queue_size <= 0)
+        return 0;
+
+    /* sub2video pushes its frames from the main thread */
+    for (i = 0; i < fg->nb_inputs; i++)
+        if (fg->inputs[i]->type == AVMEDIA_TYPE_SUBTITLE)
+            return 0;
+
+    /* the encoders configure the sinks, e.g. the audio frame size,
+     * so set them up before the thread starts pulling frames */
+    for (i = 0; i < fg->nb_outputs; i++) {
+        OutputStream *ost = fg->outputs[i]->ost;
+        char error[1024] = "";
+
+        if (ost->initialized)
+            continue;
+        ret = init_output_stream(ost, error, sizeof(error));
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error initializing output stream %d:%d -- %s\n",
+                   ost->file_index, ost->index, error);
+            exit_program(1);
+        }
+    }
+
+    return init_filtergraph_thread(fg);
+}
+#endif
+
 /**
  * Get and encode new output from any of the filtergraphs, without causing
  * activity.
@@ -1426,12 +2010,24 @@ static int reap_filters(int flush)
     AVFrame *filtered_frame = NULL;
     int i;
 
+#if HAVE_THREADS
+    for (i = 0; i < nb_filtergraphs; i++) {
+        int ret;
+
+        if (!filtergraphs[i]->in_thread_queue)
+            continue;
+        ret = reap_filtergraph_thread(filtergraphs[i], AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret < 0 && ret != AVERROR_EOF)
+            return ret;
+    }
+#endif
+
     /* Reap all buffers present in the buffer sinks */
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost = output_streams[i];
         OutputFile    *of = output_files[ost->file_index];
         AVFilterContext *filter;
-        AVCodecContext *enc = ost->enc_ctx;
+        StageTimer timer;
         int ret = 0;
 
         if (!ost->filter || !ost->filter->graph->graph)
@@ -1448,15 +2044,21 @@ static int reap_filters(int flush)
             }
         }
 
+#if HAVE_THREADS
+        if (ost->filter->graph->in_thread_queue)
+            continue;
+#endif
+
         if (!ost->filtered_frame && !(ost->filtered_frame = av_frame_alloc())) {
             return AVERROR(ENOMEM);
         }
         filtered_frame = ost->filtered_frame;
 
         while (1) {
-            double float_pts = AV_NOPTS_VALUE; // this is identical to filtered_frame.pts but with higher precision
+            stage_timer_start(&timer);
             ret = av_buffersink_get_frame_flags(filter, filtered_frame,
                                                AV_BUFFERSINK_FLAG_NO_REQUEST);
+            stage_timer_stop(&timer, &ost->filter->graph->filter_stats, ret >= 0);
             if (ret < 0) {
                 if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
                     av_log(NULL, AV_LOG_WARNING,
@@ -1471,53 +2073,7 @@ static int reap_filters(int flush)
                 av_frame_unref(filtered_frame);
                 continue;
             }
-            if (filtered_frame->pts != AV_NOPTS_VALUE) {
-                int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
-                AVRational filter_tb = av_buffersink_get_time_base(filter);
-                AVRational tb = enc->time_base;
-                int extra_bits = av_clip(29 - av_log2(tb.den), 0, 16);
-
-                tb.den <<= extra_bits;
-                float_pts =
-                    av_rescale_q(filtered_frame->pts, filter_tb, tb) -
-                    av_rescale_q(start_time, AV_TIME_BASE_Q, tb);
-                float_pts /= 1 << extra_bits;
-                // avoid exact midoints to reduce the chance of rounding differences, this can be removed in case the fps code is changed to work with integers
-                float_pts += FFSIGN(float_pts) * 1.0 / (1<<17);
-
-                filtered_frame->pts =
-                    av_rescale_q(filtered_frame->pts, filter_tb, enc->time_base) -
-                    av_rescale_q(start_time, AV_TIME_BASE_Q, enc->time_base);
-            }
-
-            switch (av_buffersink_get_type(filter)) {
-            case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
-                    enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
-                if (debug_ts) {
-                    av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s exact:%f time_base:%d/%d\n",
-                            av_ts2str(filtered_frame->pts), av_ts2timestr(filtered_frame->pts, &enc->time_base),
-                            float_pts,
-                            enc->time_base.num, enc->time_base.den);
-                }
-
-                do_video_out(of, ost, filtered_frame, float_pts);
-                break;
-            case AVMEDIA_TYPE_AUDIO:
-                if (!(enc->codec->capabilities & AV_CODEC_CAP_PARAM_CHANGE) &&
-                    enc->channels != filtered_frame->channels) {
-                    av_log(NULL, AV_LOG_ERROR,
-                           "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
-                    break;
-                }
-                do_audio_out(of, ost, filtered_frame);
-                break;
-            default:
-                // TODO support subtitle filters
-                av_assert0(0);
-            }
-
+            encode_filtered_frame(ost, filtered_frame);
             av_frame_unref(filtered_frame);
         }
     }
@@ -1841,6 +2397,142 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         print_final_stats(total_size);
 }
 
+static void bprint_json_string(AVBPrint *bp, const char *str)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; str && *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(bp, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(bp, "\\u%04x", *str);
+        else
+            av_bprint_chars(bp, *str, 1);
+    }
+    av_bprint_chars(bp, '"', 1);
+}
+
+static void bprint_stage_stats(AVBPrint *bp, const char *name, StageStats *s)
+{
+    av_bprintf(bp, "\"%s\":{\"count\":%"PRId64",\"real_usec\":%"PRId64
+               ",\"cpu_usec\":%"PRId64",\"wait_usec\":%"PRId64"}", name,
+               (int64_t)atomic_load_explicit(&s->nb,        memory_order_relaxed),
+               (int64_t)atomic_load_explicit(&s->real_usec, memory_order_relaxed),
+               (int64_t)atomic_load_explicit(&s->cpu_usec,  memory_order_relaxed),
+               (int64_t)atomic_load_explicit(&s->wait_usec, memory_order_relaxed));
+}
+
+static void bprint_media_type(AVBPrint *bp, enum AVMediaType type)
+{
+    const char *str = av_get_media_type_string(type);
+    av_bprintf(bp, "\"type\":\"%s\"", str ? str : "unknown");
+}
+
+/**
+ * Write the -benchmark_stages report as a single line of JSON to stdout
+ * or to the -benchmark_stages_file url.
+ */
+static void print_benchmark_stages(int is_last_report, int64_t timer_start, int64_t cur_time)
+{
+    static int64_t last_time = -1;
+    AVBPrint bp;
+    int i, j;
+
+    if (!do_benchmark_stages)
+        return;
+    if (!is_last_report) {
+        if (benchmark_stages_period <= 0)
+            return;
+        if (last_time == -1)
+            last_time = cur_time;
+        if (cur_time - last_time < benchmark_stages_period * 1000000)
+            return;
+        last_time = cur_time;
+    }
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "{\"benchmark_stages\":{\"final\":%s,\"real_usec\":%"PRId64,
+               is_last_report ? "true" : "false", cur_time - timer_start);
+
+    av_bprintf(&bp, ",\"inputs\":[");
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+
+        av_bprintf(&bp, "%s{\"file\":%d,\"url\":", i ? "," : "", i);
+        bprint_json_string(&bp, f->ctx->url);
+        av_bprint_chars(&bp, ',', 1);
+        bprint_stage_stats(&bp, "demux", &f->demux_stats);
+        av_bprintf(&bp, ",\"streams\":[");
+        for (j = 0; j < f->nb_streams; j++) {
+            InputStream *ist = input_streams[f->ist_index + j];
+
+            av_bprintf(&bp, "%s{\"index\":%d,", j ? "," : "", ist->st->index);
+            bprint_media_type(&bp, ist->st->codecpar->codec_type);
+            av_bprintf(&bp, ",\"codec\":\"%s\"", avcodec_get_name(ist->st->codecpar->codec_id));
+            if (ist->decoding_needed) {
+                av_bprint_chars(&bp, ',', 1);
+                bprint_stage_stats(&bp, "decode", &ist->decode_stats);
+            }
+            av_bprint_chars(&bp, '}', 1);
+        }
+        av_bprintf(&bp, "]}");
+    }
+
+    av_bprintf(&bp, "],\"filtergraphs\":[");
+    for (i = 0; i < nb_filtergraphs; i++) {
+        FilterGraph *fg = filtergraphs[i];
+
+        av_bprintf(&bp, "%s{\"index\":%d,\"simple\":%s,", i ? "," : "", i,
+                   filtergraph_is_simple(fg) ? "true" : "false");
+        bprint_stage_stats(&bp, "filter", &fg->filter_stats);
+        av_bprint_chars(&bp, '}', 1);
+    }
+
+    av_bprintf(&bp, "],\"outputs\":[");
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        av_bprintf(&bp, "%s{\"file\":%d,\"url\":", i ? "," : "", i);
+        bprint_json_string(&bp, of->ctx->url);
+        av_bprintf(&bp, ",\"streams\":[");
+        for (j = 0; j < of->ctx->nb_streams; j++) {
+            OutputStream *ost = output_streams[of->ost_index + j];
+
+            av_bprintf(&bp, "%s{\"index\":%d,", j ? "," : "", ost->index);
+            bprint_media_type(&bp, ost->st->codecpar->codec_type);
+            av_bprintf(&bp, ",\"codec\":\"%s\",", avcodec_get_name(ost->st->codecpar->codec_id));
+            if (ost->encoding_needed) {
+                bprint_stage_stats(&bp, "encode", &ost->encode_stats);
+                av_bprint_chars(&bp, ',', 1);
+            }
+            bprint_stage_stats(&bp, "mux", &ost->mux_stats);
+            av_bprint_chars(&bp, '}', 1);
+        }
+        av_bprintf(&bp, "]}");
+    }
+    av_bprintf(&bp, "]}}");
+
+    av_bprint_chars(&bp, '\n', 1);
+
+    if (!av_bprint_is_complete(&bp)) {
+        av_log(NULL, AV_LOG_ERROR, "Could not allocate the stage report\n");
+    } else if (benchmark_stages_avio) {
+        avio_write(benchmark_stages_avio, bp.str, bp.len);
+        avio_flush(benchmark_stages_avio);
+    } else {
+        fputs(bp.str, stdout);
+        fflush(stdout);
+    }
+    av_bprint_finalize(&bp, NULL);
+
+    if (is_last_report && benchmark_stages_avio) {
+        int ret = avio_closep(&benchmark_stages_avio);
+        if (ret < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing stage report, loss of information possible: %s\n",
+                   av_err2str(ret));
+    }
+}
+
 static void ifilter_parameters_from_codecpar(InputFilter *ifilter, AVCodecParameters *par)
 {
     // We never got any input. Set a fake format, which will
@@ -1862,6 +2554,7 @@ static void flush_encoders(void)
         OutputStream   *ost = output_streams[i];
         AVCodecContext *enc = ost->enc_ctx;
         OutputFile      *of = output_files[ost->file_index];
+        StageTimer    timer;
 
         if (!ost->encoding_needed)
             continue;
@@ -1904,6 +2597,13 @@ static void flush_encoders(void)
             }
         }
 
+#if HAVE_THREADS
+        if (ost->enc_frame_queue) {
+            flush_encoder_thread(of, ost);
+            continue;
+        }
+#endif
+
         if (enc->codec_type == AVMEDIA_TYPE_AUDIO && enc->frame_size <= 1)
             continue;
 
@@ -1931,6 +2631,7 @@ static void flush_encoders(void)
             pkt.size = 0;
 
             update_benchmark(NULL);
+            stage_timer_start(&timer);
 
             while ((ret = avcodec_receive_packet(enc, &pkt)) == AVERROR(EAGAIN)) {
                 ret = avcodec_send_frame(enc, NULL);
@@ -1942,6 +2643,8 @@ static void flush_encoders(void)
                 }
             }
 
+            stage_timer_stop(&timer, &ost->encode_stats, ret >= 0);
+
             update_benchmark("flush_%s %d.%d", desc, ost->file_index, ost->index);
             if (ret < 0 && ret != AVERROR_EOF) {
                 av_log(NULL, AV_LOG_FATAL, "%s encoding failed: %s\n",
@@ -2120,6 +2823,7 @@ static int ifilter_has_all_input_formats(FilterGraph *fg)
 static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
 {
     FilterGraph *fg = ifilter->graph;
+    StageTimer timer;
     int need_reinit, ret, i;
 
     /* determine if the parameters for this input changed */
@@ -2171,6 +2875,11 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
             }
         }
 
+#if HAVE_THREADS
+        if (fg->in_thread_queue)
+            stop_filtergraph_thread(fg);
+#endif
+
         ret = reap_filters(1);
         if (ret < 0 && ret != AVERROR_EOF) {
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
@@ -2182,9 +2891,32 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
             av_log(NULL, AV_LOG_ERROR, "Error reinitializing filters!\n");
             return ret;
         }
+
+#if HAVE_THREADS
+        ret = start_filtergraph_thread(fg);
+        if (ret < 0)
+            return ret;
+#endif
+    }
+
+#if HAVE_THREADS
+    if (fg->in_thread_queue) {
+        FilterThreadMessage msg = { .type = FILTER_THREAD_FRAME };
+
+        for (i = 0; fg->inputs[i] != ifilter; i++)
+            ;
+        msg.index = i;
+        if (!(msg.frame = av_frame_alloc()))
+            return AVERROR(ENOMEM);
+        av_frame_move_ref(msg.frame, frame);
+
+        return send_to_filtergraph_thread(fg, &msg);
     }
+#endif
 
+    stage_timer_start(&timer);
     ret = av_buffersrc_add_frame_flags(ifilter->filter, frame, AV_BUFFERSRC_FLAG_PUSH);
+    stage_timer_stop(&timer, &fg->filter_stats, 0);
     if (ret < 0) {
         if (ret != AVERROR_EOF)
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
@@ -2196,12 +2928,29 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
 
 static int ifilter_send_eof(InputFilter *ifilter, int64_t pts)
 {
+    StageTimer timer;
     int ret;
 
     ifilter->eof = 1;
 
+#if HAVE_THREADS
+    if (ifilter->graph->in_thread_queue) {
+        FilterGraph *fg = ifilter->graph;
+        FilterThreadMessage msg = { .type = FILTER_THREAD_EOF, .pts = pts };
+
+        while (fg->inputs[msg.index] != ifilter)
+            msg.index++;
+
+        /* the graph may have finished already */
+        ret = send_to_filtergraph_thread(fg, &msg);
+        return ret == AVERROR_EOF ? 0 : ret;
+    }
+#endif
+
     if (ifilter->filter) {
+        stage_timer_start(&timer);
         ret = av_buffersrc_close(ifilter->filter, pts, AV_BUFFERSRC_FLAG_PUSH);
+        stage_timer_stop(&timer, &ifilter->graph->filter_stats, 0);
         if (ret < 0)
             return ret;
     } else {
@@ -2275,6 +3024,7 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
 {
     AVFrame *decoded_frame;
     AVCodecContext *avctx = ist->dec_ctx;
+    StageTimer timer;
     int ret, err = 0;
     AVRational decoded_frame_tb;
 
@@ -2285,7 +3035,9 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     decoded_frame = ist->decoded_frame;
 
     update_benchmark(NULL);
+    stage_timer_start(&timer);
     ret = decode(avctx, decoded_frame, got_output, pkt);
+    stage_timer_stop(&timer, &ist->decode_stats, *got_output);
     update_benchmark("decode_audio %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -2340,6 +3092,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     int64_t best_effort_timestamp;
     int64_t dts = AV_NOPTS_VALUE;
     AVPacket avpkt;
+    StageTimer timer;
 
     // With fate-indeo3-2, we're getting 0-sized packets before EOF for some
     // reason. This seems like a semi-critical bug. Don't trigger EOF, and
@@ -2370,7 +3123,9 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     }
 
     update_benchmark(NULL);
+    stage_timer_start(&timer);
     ret = decode(ist->dec_ctx, decoded_frame, got_output, pkt ? &avpkt : NULL);
+    stage_timer_stop(&timer, &ist->decode_stats, *got_output);
     update_benchmark("decode_video %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -2469,9 +3224,13 @@ static int transcode_subtitles(InputStream *ist, AVPacket *pkt, int *got_output,
                                int *decode_failed)
 {
     AVSubtitle subtitle;
+    StageTimer timer;
     int free_sub = 1;
-    int i, ret = avcodec_decode_subtitle2(ist->dec_ctx,
-                                          &subtitle, got_output, pkt);
+    int i, ret;
+
+    stage_timer_start(&timer);
+    ret = avcodec_decode_subtitle2(ist->dec_ctx, &subtitle, got_output, pkt);
+    stage_timer_stop(&timer, &ist->decode_stats, ret >= 0 && *got_output);
 
     check_decode_result(NULL, got_output, ret);
 
@@ -3580,6 +4339,22 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
             ost->st->duration = av_rescale_q(ist->st->duration, ist->st->time_base, ost->st->time_base);
 
         ost->st->codec->codec= ost->enc_ctx->codec;
+
+#if HAVE_THREADS
+        if (ost->enc_thread_queue_size > 0 &&
+            (ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO ||
+             ost->enc_ctx->codec_type == AVMEDIA_TYPE_AUDIO)) {
+            if (ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO && vstats_filename) {
+                av_log(NULL, AV_LOG_WARNING, "-vstats needs the encoder state, "
+                       "encoding output stream #%d:%d on the main thread\n",
+                       ost->file_index, ost->index);
+            } else if ((ret = init_encoder_thread(ost)) < 0) {
+                snprintf(error, error_len, "Could not start the encoder thread "
+                         "for output stream #%d:%d", ost->file_index, ost->index);
+                return ret;
+            }
+        }
+#endif
     } else if (ost->stream_copy) {
         ret = init_output_stream_streamcopy(ost);
         if (ret < 0)
@@ -3873,6 +4648,12 @@ static OutputStream *choose_output(void)
         if (!ost->initialized && !ost->inputs_done)
             return ost;
 
+        /* the muxed timestamps of a threaded encoder depend on how far
+         * it got, use what has been sent to it to stay deterministic */
+        if (encoder_thread_running(ost))
+            opts = av_rescale_q(ost->sync_opts, ost->enc_ctx->time_base,
+                                AV_TIME_BASE_Q);
+
         if (!ost->finished && opts < opts_min) {
             opts_min = opts;
             ost_min  = ost->unavailable ? NULL : ost;
@@ -3938,6 +4719,12 @@ static int check_keyboard_interaction(int64_t cur_time)
                    target, time, command, arg);
             for (i = 0; i < nb_filtergraphs; i++) {
                 FilterGraph *fg = filtergraphs[i];
+#if HAVE_THREADS
+                if (fg->in_thread_queue) {
+                    fprintf(stderr, "Filtergraph %d runs in its own thread, commands are not supported\n", i);
+                    continue;
+                }
+#endif
                 if (fg->graph) {
                     if (time < 0) {
                         ret = avfilter_graph_send_command(fg->graph, target, command, arg, buf, sizeof(buf),
@@ -4019,7 +4806,11 @@ static void *input_thread(void *arg)
 
     while (1) {
         AVPacket pkt;
+        StageTimer timer;
+
+        stage_timer_start(&timer);
         ret = av_read_frame(f->ctx, &pkt);
+        stage_timer_stop(&timer, &f->demux_stats, ret >= 0);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -4115,14 +4906,23 @@ static int init_input_threads(void)
 
 static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
 {
-    return av_thread_message_queue_recv(f->in_thread_queue, pkt,
-                                        f->non_blocking ?
-                                        AV_THREAD_MESSAGE_NONBLOCK : 0);
+    StageTimer timer;
+    int ret;
+
+    stage_timer_start(&timer);
+    ret = av_thread_message_queue_recv(f->in_thread_queue, pkt,
+                                       f->non_blocking ?
+                                       AV_THREAD_MESSAGE_NONBLOCK : 0);
+    stage_timer_stop_wait(&timer, &f->demux_stats);
+    return ret;
 }
 #endif
 
 static int get_input_packet(InputFile *f, AVPacket *pkt)
 {
+    StageTimer timer;
+    int ret;
+
     if (f->rate_emu) {
         int i;
         for (i = 0; i < f->nb_streams; i++) {
@@ -4138,7 +4938,10 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     if (nb_input_files > 1)
         return get_input_packet_mt(f, pkt);
 #endif
-    return av_read_frame(f->ctx, pkt);
+    stage_timer_start(&timer);
+    ret = av_read_frame(f->ctx, pkt);
+    stage_timer_stop(&timer, &f->demux_stats, ret >= 0);
+    return ret;
 }
 
 static int got_eagain(void)
@@ -4527,9 +5330,37 @@ static int transcode_from_filter(FilterGraph *graph, InputStream **best_ist)
     int nb_requests, nb_requests_max = 0;
     InputFilter *ifilter;
     InputStream *ist;
+    StageTimer timer;
 
     *best_ist = NULL;
+
+#if HAVE_THREADS
+    if (graph->in_thread_queue) {
+        /* wait for frames unless the graph waits for input */
+        ret = reap_filtergraph_thread(graph, graph->wanted_input < 0 ? 0 : AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret < 0)
+            return ret == AVERROR_EOF ? 0 : ret;
+        if (graph->wanted_input < 0)
+            return 0;
+
+        /* the input asked for first, then any input that can be read */
+        for (i = 0; i < graph->nb_inputs; i++) {
+            ist = graph->inputs[(graph->wanted_input + i) % graph->nb_inputs]->ist;
+            if (!input_files[ist->file_index]->eagain &&
+                !input_files[ist->file_index]->eof_reached) {
+                *best_ist = ist;
+                return 0;
+            }
+        }
+        for (i = 0; i < graph->nb_outputs; i++)
+            graph->outputs[i]->ost->unavailable = 1;
+        return 0;
+    }
+#endif
+
+    stage_timer_start(&timer);
     ret = avfilter_graph_request_oldest(graph->graph);
+    stage_timer_stop(&timer, &graph->filter_stats, 0);
     if (ret >= 0)
         return reap_filters(0);
 
@@ -4591,6 +5422,11 @@ static int transcode_step(void)
                 av_log(NULL, AV_LOG_ERROR, "Error reinitializing filters!\n");
                 return ret;
             }
+#if HAVE_THREADS
+            ret = start_filtergraph_thread(ost->filter->graph);
+            if (ret < 0)
+                return ret;
+#endif
         }
     }
 
@@ -4688,9 +5524,11 @@ static int transcode(void)
 
         /* dump report by using the output first video and audio streams */
         print_report(0, timer_start, cur_time);
+        print_benchmark_stages(0, timer_start, cur_time);
     }
 #if HAVE_THREADS
     free_input_threads();
+    stop_filtergraph_threads();
 #endif
 
     /* at the end of stream, we must flush the decoder buffers */
@@ -4723,6 +5561,7 @@ static int transcode(void)
 
     /* dump report by using the first video and audio streams */
     print_report(1, timer_start, av_gettime_relative());
+    print_benchmark_stages(1, timer_start, av_gettime_relative());
 
     /* close each encoder */
     for (i = 0; i < nb_output_streams; i++) {
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <signal.h>
+#include <stdatomic.h>
 
 #include "cmdutils.h"
 
@@ -216,6 +217,8 @@ typedef struct OptionsContext {
     int        nb_passlogfiles;
     SpecifierOpt *max_muxing_queue_size;
     int        nb_max_muxing_queue_size;
+    SpecifierOpt *enc_thread_queue_size;
+    int        nb_enc_thread_queue_size;
     SpecifierOpt *guess_layout_max;
     int        nb_guess_layout_max;
     SpecifierOpt *apad;
@@ -232,6 +235,29 @@ typedef struct OptionsContext {
     int        nb_enc_time_bases;
 } OptionsContext;
 
+#if HAVE_THREADS
+/* messages a worker thread took from or added to its queues, so that
+ * the main thread can sleep until one of them changes */
+typedef struct ThreadProgress {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    unsigned        count;
+} ThreadProgress;
+#endif
+
+/* per-stage statistics for -benchmark_stages, updated from any thread */
+typedef struct StageStats {
+    atomic_int_least64_t nb;        /* frames or packets out of the stage */
+    atomic_int_least64_t real_usec; /* wall clock time spent in the stage */
+    atomic_int_least64_t cpu_usec;  /* CPU time of the thread running it */
+    atomic_int_least64_t wait_usec; /* main thread time blocked on its queues */
+} StageStats;
+
+typedef struct StageTimer {
+    int64_t real_usec;
+    int64_t cpu_usec;
+} StageTimer;
+
 typedef struct InputFilter {
     AVFilterContext    *filter;
     struct InputStream *ist;
@@ -290,8 +316,32 @@ typedef struct FilterGraph {
     int          nb_inputs;
     OutputFilter **outputs;
     int         nb_outputs;
+
+#if HAVE_THREADS
+    AVThreadMessageQueue *in_thread_queue;  /* FilterThreadMessage to the graph thread */
+    AVThreadMessageQueue *out_thread_queue; /* FilterThreadMessage from the graph thread */
+    pthread_t thread;
+    int wanted_input;           /* input the thread asked for, -1 if none */
+    ThreadProgress thread_progress;
+#endif
+
+    StageStats filter_stats;
 } FilterGraph;
 
+enum FilterThreadMessageType {
+    FILTER_THREAD_FRAME,        /* frame for/from the filter with the given index */
+    FILTER_THREAD_EOF,          /* EOF at pts on the given input */
+    FILTER_THREAD_NEED_INPUT,   /* the graph needs a frame on the given input */
+    FILTER_THREAD_STOP,         /* stop the thread after the queued messages */
+};
+
+typedef struct FilterThreadMessage {
+    enum FilterThreadMessageType type;
+    int index;
+    AVFrame *frame;
+    int64_t pts;
+} FilterThreadMessage;
+
 typedef struct InputStream {
     int file_index;
     AVStream *st;
@@ -387,6 +437,8 @@ typedef struct InputStream {
     int64_t *dts_buffer;
     int nb_dts_buffer;
 
+    StageStats decode_stats;
+
     int got_output;
 } InputStream;
 
@@ -412,6 +464,8 @@ typedef struct InputFile {
     int rate_emu;
     int accurate_seek;
 
+    StageStats demux_stats;
+
 #if HAVE_THREADS
     AVThreadMessageQueue *in_thread_queue;
     pthread_t thread;           /* thread reading from this file */
@@ -544,11 +598,24 @@ typedef struct OutputStream {
     /* the packets are buffered here until the muxer is ready to be initialized */
     AVFifoBuffer *muxing_queue;
 
+    /* maximum number of frames queued for the encoder thread,
+     * 0 to encode on the main thread */
+    int enc_thread_queue_size;
+#if HAVE_THREADS
+    AVThreadMessageQueue *enc_frame_queue;  /* frames sent to the encoder thread */
+    AVThreadMessageQueue *enc_packet_queue; /* packets returned by the encoder thread */
+    pthread_t enc_thread;
+    ThreadProgress enc_progress;
+#endif
+
     /* packet picture type */
     int pict_type;
 
     /* frame encode sum of squared error values */
     int64_t error[4];
+
+    StageStats encode_stats;
+    StageStats mux_stats;
 } OutputStream;
 
 typedef struct OutputFile {
@@ -590,6 +657,8 @@ extern int video_sync_method;
 extern float frame_drop_threshold;
 extern int do_benchmark;
 extern int do_benchmark_all;
+extern int do_benchmark_stages;
+extern float benchmark_stages_period;
 extern int do_deinterlace;
 extern int do_hex_dump;
 extern int do_pkt_dump;
@@ -604,11 +673,13 @@ extern int qp_hist;
 extern int stdin_interaction;
 extern int frame_bits_per_raw_sample;
 extern AVIOContext *progress_avio;
+extern AVIOContext *benchmark_stages_avio;
 extern float max_error_rate;
 extern char *videotoolbox_pixfmt;
 
 extern int filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int filter_thread_queue_size;
 extern int vstats_version;
 
 extern const AVIOInterruptCB int_cb;
@@ -645,9 +716,25 @@ int ist_in_filtergraph(FilterGraph *fg, InputStream *ist);
 int filtergraph_is_simple(FilterGraph *fg);
 int init_simple_filtergraph(InputStream *ist, OutputStream *ost);
 int init_complex_filtergraph(FilterGraph *fg);
+#if HAVE_THREADS
+int init_filtergraph_thread(FilterGraph *fg);
+void free_filtergraph_thread(FilterGraph *fg);
+#endif
 
 void sub2video_update(InputStream *ist, AVSubtitle *sub);
 
+void stage_timer_start(StageTimer *t);
+void stage_timer_stop(const StageTimer *t, StageStats *s, int nb);
+void stage_timer_stop_wait(const StageTimer *t, StageStats *s);
+
+#if HAVE_THREADS
+int thread_progress_init(ThreadProgress *p);
+void thread_progress_uninit(ThreadProgress *p);
+unsigned thread_progress_get(ThreadProgress *p);
+void thread_progress_signal(ThreadProgress *p);
+void thread_progress_wait(ThreadProgress *p, unsigned count);
+#endif
+
 int ifilter_parameters_from_frame(InputFilter *ifilter, const AVFrame *frame);
 
 int ffmpeg_parse_options(int argc, char **argv);
@@ -1218,3 +1218,217 @@ int filtergraph_is_simple(FilterGraph *fg)
 {
     return !fg->graph_desc;
 }
+
+#if HAVE_THREADS
+static void free_filter_thread_message(void *msg)
+{
+    FilterThreadMessage *m = msg;
+    av_frame_free(&m->frame);
+}
+
+static int filter_thread_send(FilterGraph *fg, enum FilterThreadMessageType type,
+                              int index, AVFrame *frame)
+{
+    FilterThreadMessage msg = { .type = type, .index = index, .frame = frame };
+    int ret;
+
+    ret = av_thread_message_queue_send(fg->out_thread_queue, &msg, 0);
+    if (ret < 0)
+        av_frame_free(&msg.frame);
+    else
+        thread_progress_signal(&fg->thread_progress);
+    return ret;
+}
+
+/* pass all the frames available in the sinks to the main thread */
+static int filter_thread_reap(FilterGraph *fg)
+{
+    StageTimer timer;
+    int i, ret;
+
+    for (i = 0; i < fg->nb_outputs; i++) {
+        AVFilterContext *sink = fg->outputs[i]->filter;
+
+        while (1) {
+            AVFrame *frame = av_frame_alloc();
+            if (!frame)
+                return AVERROR(ENOMEM);
+
+            stage_timer_start(&timer);
+            ret = av_buffersink_get_frame_flags(sink, frame,
+                                               AV_BUFFERSINK_FLAG_NO_REQUEST);
+            stage_timer_stop(&timer, &fg->filter_stats, ret >= 0);
+            if (ret < 0) {
+                av_frame_free(&frame);
+                if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+                    av_log(NULL, AV_LOG_WARNING,
+                           "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
+                break;
+            }
+
+            ret = filter_thread_send(fg, FILTER_THREAD_FRAME, i, frame);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
+static void filter_thread_push(FilterGraph *fg, FilterThreadMessage *msg, uint8_t *in_eof)
+{
+    AVFilterContext *src = fg->inputs[msg->index]->filter;
+    StageTimer timer;
+    int ret;
+
+    stage_timer_start(&timer);
+    if (msg->type == FILTER_THREAD_EOF) {
+        in_eof[msg->index] = 1;
+        ret = av_buffersrc_close(src, msg->pts, AV_BUFFERSRC_FLAG_PUSH);
+    } else {
+        ret = av_buffersrc_add_frame_flags(src, msg->frame, AV_BUFFERSRC_FLAG_PUSH);
+        av_frame_free(&msg->frame);
+    }
+    stage_timer_stop(&timer, &fg->filter_stats, 0);
+    if (ret < 0 && ret != AVERROR_EOF)
+        av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
+}
+
+/* the input which most often lacked a frame, same as transcode_from_filter() */
+static int filter_thread_wanted_input(FilterGraph *fg, const uint8_t *in_eof)
+{
+    int i, nb_requests, nb_requests_max = 0, best = 0;
+
+    for (i = 0; i < fg->nb_inputs; i++) {
+        if (in_eof[i])
+            continue;
+        nb_requests = av_buffersrc_get_nb_failed_requests(fg->inputs[i]->filter);
+        if (nb_requests > nb_requests_max) {
+            nb_requests_max = nb_requests;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Run the graph until the main thread stops it or the graph reaches EOF.
+ * Whenever the graph cannot go on without input, the thread asks the main
+ * thread for a frame on the input it needs most and waits for it.
+ */
+static void *filtergraph_thread(void *arg)
+{
+    FilterGraph *fg = arg;
+    FilterThreadMessage msg;
+    StageTimer timer;
+    unsigned flags = AV_THREAD_MESSAGE_NONBLOCK;
+    uint8_t *in_eof;
+    int ret = 0;
+
+    in_eof = av_mallocz(FFMAX(fg->nb_inputs, 1));
+    if (!in_eof)
+        ret = AVERROR(ENOMEM);
+
+    while (ret >= 0) {
+        /* push everything queued before running the graph */
+        ret = av_thread_message_queue_recv(fg->in_thread_queue, &msg, flags);
+        if (ret >= 0) {
+            thread_progress_signal(&fg->thread_progress);
+            flags = AV_THREAD_MESSAGE_NONBLOCK;
+            if (msg.type == FILTER_THREAD_STOP) {
+                ret = filter_thread_reap(fg);
+                if (ret >= 0)
+                    ret = AVERROR_EXIT;
+                break;
+            }
+            filter_thread_push(fg, &msg, in_eof);
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        ret = filter_thread_reap(fg);
+        if (ret < 0)
+            break;
+
+        stage_timer_start(&timer);
+        ret = avfilter_graph_request_oldest(fg->graph);
+        stage_timer_stop(&timer, &fg->filter_stats, 0);
+        if (ret >= 0)
+            continue;
+        if (ret == AVERROR_EOF) {
+            ret = filter_thread_reap(fg);
+            if (ret >= 0)
+                ret = AVERROR_EOF;
+            break;
+        }
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        ret = filter_thread_send(fg, FILTER_THREAD_NEED_INPUT,
+                                 filter_thread_wanted_input(fg, in_eof), NULL);
+        flags = 0;
+    }
+
+    /* AVERROR_EOF when the graph is done, AVERROR_EXIT when stopped */
+    av_thread_message_queue_set_err_send(fg->in_thread_queue, ret);
+    av_thread_message_queue_set_err_recv(fg->out_thread_queue, ret);
+    thread_progress_signal(&fg->thread_progress);
+    av_free(in_eof);
+
+    return NULL;
+}
+
+int init_filtergraph_thread(FilterGraph *fg)
+{
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&fg->in_thread_queue, filter_thread_queue_size,
+                                        sizeof(FilterThreadMessage));
+    if (ret < 0)
+        return ret;
+    ret = av_thread_message_queue_alloc(&fg->out_thread_queue, filter_thread_queue_size,
+                                        sizeof(FilterThreadMessage));
+    if (ret < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(fg->in_thread_queue, free_filter_thread_message);
+    av_thread_message_queue_set_free_func(fg->out_thread_queue, free_filter_thread_message);
+
+    if ((ret = thread_progress_init(&fg->thread_progress)) < 0)
+        goto fail;
+
+    fg->wanted_input = -1;
+
+    if ((ret = pthread_create(&fg->thread, NULL, filtergraph_thread, fg))) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+        ret = AVERROR(ret);
+        thread_progress_uninit(&fg->thread_progress);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    av_thread_message_queue_free(&fg->in_thread_queue);
+    av_thread_message_queue_free(&fg->out_thread_queue);
+    return ret;
+}
+
+void free_filtergraph_thread(FilterGraph *fg)
+{
+    if (!fg->in_thread_queue)
+        return;
+
+    /* wake the thread up whether it waits for input or for room
+     * to return a frame */
+    av_thread_message_queue_set_err_recv(fg->in_thread_queue, AVERROR_EOF);
+    av_thread_message_flush(fg->in_thread_queue);
+    av_thread_message_queue_set_err_send(fg->out_thread_queue, AVERROR_EOF);
+    av_thread_message_flush(fg->out_thread_queue);
+
+    pthread_join(fg->thread, NULL);
+    thread_progress_uninit(&fg->thread_progress);
+    av_thread_message_queue_free(&fg->in_thread_queue);
+    av_thread_message_queue_free(&fg->out_thread_queue);
+}
+#endif
@@ -33,6 +33,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
+#include "libavutil/cpu.h"
 #include "libavutil/display.h"
 #include "libavutil/hash.h"
 #include "libavutil/mastering_display_metadata.h"
@@ -118,6 +119,8 @@ static int show_private_data            = 1;
 static char *print_format;
 static char *stream_specifier;
 static char *show_data_hash;
+static char *batch_list;
+static int batch_threads = 0;
 
 typedef struct ReadInterval {
     int id;             ///< identifier
@@ -2840,31 +2843,40 @@ static int open_input_file(InputFile *ifile, const char *filename)
 {
     int err, i;
     AVFormatContext *fmt_ctx = NULL;
+    AVDictionary *fmt_opts = NULL;
     AVDictionaryEntry *t;
     int scan_all_pmts_set = 0;
 
     fmt_ctx = avformat_alloc_context();
     if (!fmt_ctx) {
         print_error(filename, AVERROR(ENOMEM));
-        exit_program(1);
+        return AVERROR(ENOMEM);
     }
 
-    if (!av_dict_get(format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
-        av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
+    /* work on a copy, inputs may be opened concurrently in batch mode */
+    if ((err = av_dict_copy(&fmt_opts, format_opts, 0)) < 0) {
+        avformat_free_context(fmt_ctx);
+        return err;
+    }
+    if (!av_dict_get(fmt_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
+        av_dict_set(&fmt_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
         scan_all_pmts_set = 1;
     }
     if ((err = avformat_open_input(&fmt_ctx, filename,
-                                   iformat, &format_opts)) < 0) {
+                                   iformat, &fmt_opts)) < 0) {
         print_error(filename, err);
+        av_dict_free(&fmt_opts);
         return err;
     }
     ifile->fmt_ctx = fmt_ctx;
     if (scan_all_pmts_set)
-        av_dict_set(&format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE);
-    if ((t = av_dict_get(format_opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
+        av_dict_set(&fmt_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE);
+    if ((t = av_dict_get(fmt_opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
         av_log(NULL, AV_LOG_ERROR, "Option %s not found.\n", t->key);
+        av_dict_free(&fmt_opts);
         return AVERROR_OPTION_NOT_FOUND;
     }
+    av_dict_free(&fmt_opts);
 
     if (find_stream_info) {
         AVDictionary **opts = setup_find_stream_info_opts(fmt_ctx, codec_opts);
@@ -2887,7 +2899,7 @@ static int open_input_file(InputFile *ifile, const char *filename)
     ifile->streams = av_mallocz_array(fmt_ctx->nb_streams,
                                       sizeof(*ifile->streams));
     if (!ifile->streams)
-        exit(1);
+        return AVERROR(ENOMEM);
     ifile->nb_streams = fmt_ctx->nb_streams;
 
     /* bind a decoder to each input stream */
@@ -2917,18 +2929,15 @@ static int open_input_file(InputFile *ifile, const char *filename)
                                                    fmt_ctx, stream, codec);
 
             ist->dec_ctx = avcodec_alloc_context3(codec);
-            if (!ist->dec_ctx)
-                exit(1);
+            if (!ist->dec_ctx) {
+                av_dict_free(&opts);
+                return AVERROR(ENOMEM);
+            }
 
             err = avcodec_parameters_to_context(ist->dec_ctx, stream->codecpar);
-            if (err < 0)
-                exit(1);
-
-            if (do_show_log) {
-                // For loging it is needed to disable at least frame threads as otherwise
-                // the log information would need to be reordered and matches up to contexts and frames
-                // That is in fact possible but not trivial
-                av_dict_set(&codec_opts, "threads", "1", 0);
+            if (err < 0) {
+                av_dict_free(&opts);
+                return err;
             }
 
             ist->dec_ctx->pkt_timebase = stream->time_base;
@@ -2938,17 +2947,20 @@ static int open_input_file(InputFile *ifile, const char *filename)
             ist->dec_ctx->coded_height = stream->codec->coded_height;
 #endif
 
-            if (avcodec_open2(ist->dec_ctx, codec, &opts) < 0) {
+            if ((err = avcodec_open2(ist->dec_ctx, codec, &opts)) < 0) {
                 av_log(NULL, AV_LOG_WARNING, "Could not open codec for input stream %d\n",
                        stream->index);
-                exit(1);
+                av_dict_free(&opts);
+                return err;
             }
 
             if ((t = av_dict_get(opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
                 av_log(NULL, AV_LOG_ERROR, "Option %s for input stream %d not found\n",
                        t->key, stream->index);
+                av_dict_free(&opts);
                 return AVERROR_OPTION_NOT_FOUND;
             }
+            av_dict_free(&opts);
         }
     }
 
@@ -2971,30 +2983,25 @@ static void close_input_file(InputFile *ifile)
     avformat_close_input(&ifile->fmt_ctx);
 }
 
-static int probe_file(WriterContext *wctx, const char *filename)
+static int show_input_file(WriterContext *wctx, InputFile *ifile)
 {
-    InputFile ifile = { 0 };
-    int ret, i;
+    int ret = 0, i;
     int section_id;
 
     do_read_frames = do_show_frames || do_count_frames;
     do_read_packets = do_show_packets || do_count_packets;
 
-    ret = open_input_file(&ifile, filename);
-    if (ret < 0)
-        goto end;
-
 #define CHECK_END if (ret < 0) goto end
 
-    nb_streams = ifile.fmt_ctx->nb_streams;
-    REALLOCZ_ARRAY_STREAM(nb_streams_frames,0,ifile.fmt_ctx->nb_streams);
-    REALLOCZ_ARRAY_STREAM(nb_streams_packets,0,ifile.fmt_ctx->nb_streams);
-    REALLOCZ_ARRAY_STREAM(selected_streams,0,ifile.fmt_ctx->nb_streams);
+    nb_streams = ifile->fmt_ctx->nb_streams;
+    REALLOCZ_ARRAY_STREAM(nb_streams_frames,0,ifile->fmt_ctx->nb_streams);
+    REALLOCZ_ARRAY_STREAM(nb_streams_packets,0,ifile->fmt_ctx->nb_streams);
+    REALLOCZ_ARRAY_STREAM(selected_streams,0,ifile->fmt_ctx->nb_streams);
 
-    for (i = 0; i < ifile.fmt_ctx->nb_streams; i++) {
+    for (i = 0; i < ifile->fmt_ctx->nb_streams; i++) {
         if (stream_specifier) {
-            ret = avformat_match_stream_specifier(ifile.fmt_ctx,
-                                                  ifile.fmt_ctx->streams[i],
+            ret = avformat_match_stream_specifier(ifile->fmt_ctx,
+                                                  ifile->fmt_ctx->streams[i],
                                                   stream_specifier);
             CHECK_END;
             else
@@ -3004,7 +3011,7 @@ static int probe_file(WriterContext *wctx, const char *filename)
             selected_streams[i] = 1;
         }
         if (!selected_streams[i])
-            ifile.fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+            ifile->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
     }
 
     if (do_read_frames || do_read_packets) {
@@ -3017,33 +3024,31 @@ static int probe_file(WriterContext *wctx, const char *filename)
             section_id = SECTION_ID_FRAMES;
         if (do_show_frames || do_show_packets)
             writer_print_section_header(wctx, section_id);
-        ret = read_packets(wctx, &ifile);
+        ret = read_packets(wctx, ifile);
         if (do_show_frames || do_show_packets)
             writer_print_section_footer(wctx);
         CHECK_END;
     }
 
     if (do_show_programs) {
-        ret = show_programs(wctx, &ifile);
+        ret = show_programs(wctx, ifile);
         CHECK_END;
     }
 
     if (do_show_streams) {
-        ret = show_streams(wctx, &ifile);
+        ret = show_streams(wctx, ifile);
         CHECK_END;
     }
     if (do_show_chapters) {
-        ret = show_chapters(wctx, &ifile);
+        ret = show_chapters(wctx, ifile);
         CHECK_END;
     }
     if (do_show_format) {
-        ret = show_format(wctx, &ifile);
+        ret = show_format(wctx, ifile);
         CHECK_END;
     }
 
 end:
-    if (ifile.fmt_ctx)
-        close_input_file(&ifile);
     av_freep(&nb_streams_frames);
     av_freep(&nb_streams_packets);
     av_freep(&selected_streams);
@@ -3051,6 +3056,20 @@ end:
     return ret;
 }
 
+static int probe_file(WriterContext *wctx, const char *filename)
+{
+    InputFile ifile = { 0 };
+    int ret;
+
+    ret = open_input_file(&ifile, filename);
+    if (ret >= 0)
+        ret = show_input_file(wctx, &ifile);
+    if (ifile.fmt_ctx)
+        close_input_file(&ifile);
+
+    return ret;
+}
+
 static void show_usage(void)
 {
     av_log(NULL, AV_LOG_INFO, "Simple multimedia streams analyzer\n");
@@ -3157,6 +3176,245 @@ static void ffprobe_show_pixel_formats(WriterContext *w)
     writer_print_section_footer(w);
 }
 
+static void show_versions_and_formats(WriterContext *wctx)
+{
+    if (do_show_program_version)
+        ffprobe_show_program_version(wctx);
+    if (do_show_library_versions)
+        ffprobe_show_library_versions(wctx);
+    if (do_show_pixel_formats)
+        ffprobe_show_pixel_formats(wctx);
+}
+
+typedef struct BatchInput {
+    char *filename;
+    InputFile ifile;
+    int ret;                    ///< return value of open_input_file()
+    int opened;                 ///< set once ifile and ret are valid
+} BatchInput;
+
+typedef struct BatchContext {
+    BatchInput *inputs;
+    int      nb_inputs;
+    int next_open;              ///< index of the next input to open
+    int next_show;              ///< index of the next input to print
+    int max_ahead;              ///< maximum number of inputs opened but not printed yet
+#if HAVE_THREADS
+    pthread_t *threads;
+    int     nb_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+#endif
+} BatchContext;
+
+static int read_batch_list(BatchContext *batch, const char *filename)
+{
+    AVIOContext *pb = NULL;
+    AVBPrint bp;
+    char *line, *saveptr = NULL;
+    int ret;
+
+    if (!strcmp(filename, "-"))
+        filename = "pipe:";
+    if ((ret = avio_open(&pb, filename, AVIO_FLAG_READ)) < 0) {
+        print_error(filename, ret);
+        return ret;
+    }
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    ret = avio_read_to_bprint(pb, &bp, SIZE_MAX);
+    avio_closep(&pb);
+    if (ret >= 0 && !av_bprint_is_complete(&bp))
+        ret = AVERROR(ENOMEM);
+    if (ret < 0) {
+        print_error(filename, ret);
+        goto end;
+    }
+
+    /* one input per line, empty lines are skipped */
+    for (line = av_strtok(bp.str, "\r\n", &saveptr); line;
+         line = av_strtok(NULL, "\r\n", &saveptr)) {
+        BatchInput *input = av_dynarray2_add((void **)&batch->inputs, &batch->nb_inputs,
+                                             sizeof(*batch->inputs), NULL);
+        if (!input) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        memset(input, 0, sizeof(*input));
+        if (!(input->filename = av_strdup(line))) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+end:
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
+
+#if HAVE_THREADS
+static void *batch_open_thread(void *arg)
+{
+    BatchContext *batch = arg;
+
+    pthread_mutex_lock(&batch->lock);
+    while (1) {
+        BatchInput *input;
+        int ret;
+
+        /* do not open too many inputs ahead of the main thread */
+        while (batch->next_open < batch->nb_inputs &&
+               batch->next_open >= batch->next_show + batch->max_ahead)
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        if (batch->next_open >= batch->nb_inputs)
+            break;
+        input = &batch->inputs[batch->next_open++];
+        pthread_mutex_unlock(&batch->lock);
+
+        ret = open_input_file(&input->ifile, input->filename);
+
+        pthread_mutex_lock(&batch->lock);
+        input->ret    = ret;
+        input->opened = 1;
+        pthread_cond_broadcast(&batch->cond);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    return NULL;
+}
+
+static int init_batch_threads(BatchContext *batch)
+{
+    int nb_threads = batch_threads > 0 ? batch_threads : av_cpu_count();
+    int i, ret;
+
+    nb_threads = FFMIN(nb_threads, batch->nb_inputs);
+    if (nb_threads <= 1)
+        return 0;
+
+    batch->threads = av_malloc_array(nb_threads, sizeof(*batch->threads));
+    if (!batch->threads)
+        return AVERROR(ENOMEM);
+    if ((ret = pthread_mutex_init(&batch->lock, NULL))) {
+        av_freep(&batch->threads);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&batch->cond, NULL))) {
+        pthread_mutex_destroy(&batch->lock);
+        av_freep(&batch->threads);
+        return AVERROR(ret);
+    }
+    batch->max_ahead = 2 * nb_threads;
+
+    for (i = 0; i < nb_threads; i++) {
+        if ((ret = pthread_create(&batch->threads[i], NULL, batch_open_thread, batch))) {
+            av_log(NULL, AV_LOG_WARNING, "pthread_create failed: %s, "
+                   "using %d batch threads\n", strerror(ret), i);
+            break;
+        }
+        batch->nb_threads++;
+    }
+
+    return 0;
+}
+
+static void free_batch_threads(BatchContext *batch)
+{
+    int i;
+
+    if (!batch->threads)
+        return;
+
+    for (i = 0; i < batch->nb_threads; i++)
+        pthread_join(batch->threads[i], NULL);
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+    av_freep(&batch->threads);
+}
+#endif
+
+/* wait until input has been opened, or open it on this thread */
+static void batch_open_input(BatchContext *batch, BatchInput *input)
+{
+#if HAVE_THREADS
+    if (batch->nb_threads) {
+        pthread_mutex_lock(&batch->lock);
+        while (!input->opened)
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        pthread_mutex_unlock(&batch->lock);
+        return;
+    }
+#endif
+    input->ret = open_input_file(&input->ifile, input->filename);
+}
+
+static void batch_input_done(BatchContext *batch, BatchInput *input)
+{
+    if (input->ifile.fmt_ctx)
+        close_input_file(&input->ifile);
+#if HAVE_THREADS
+    if (batch->nb_threads) {
+        pthread_mutex_lock(&batch->lock);
+        batch->next_show++;
+        pthread_cond_broadcast(&batch->cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+#endif
+}
+
+/*
+ * Probe every input of the list, printing a complete output record per
+ * input in the order of the list. The inputs are opened concurrently
+ * ahead of the one being printed, and an input failing does not stop
+ * the others.
+ */
+static int probe_batch(WriterContext *wctx, const char *list)
+{
+    BatchContext batch = { 0 };
+    int i, ret, nb_failed = 0;
+
+    if ((ret = read_batch_list(&batch, list)) < 0)
+        goto end;
+#if HAVE_THREADS
+    if ((ret = init_batch_threads(&batch)) < 0)
+        goto end;
+#endif
+
+    for (i = 0; i < batch.nb_inputs; i++) {
+        BatchInput *input = &batch.inputs[i];
+
+        batch_open_input(&batch, input);
+
+        writer_print_section_header(wctx, SECTION_ID_ROOT);
+        show_versions_and_formats(wctx);
+        ret = input->ret;
+        if (ret >= 0)
+            ret = show_input_file(wctx, &input->ifile);
+        if (ret < 0) {
+            nb_failed++;
+            if (do_show_error)
+                show_error(wctx, ret);
+        }
+        writer_print_section_footer(wctx);
+        fflush(stdout);
+
+        batch_input_done(&batch, input);
+    }
+
+    if (nb_failed)
+        av_log(NULL, AV_LOG_ERROR, "%d of %d inputs could not be probed\n",
+               nb_failed, batch.nb_inputs);
+    ret = nb_failed ? AVERROR_INVALIDDATA : 0;
+
+end:
+#if HAVE_THREADS
+    free_batch_threads(&batch);
+#endif
+    for (i = 0; i < batch.nb_inputs; i++)
+        av_freep(&batch.inputs[i].filename);
+    av_freep(&batch.inputs);
+    return ret;
+}
+
 static int opt_format(void *optctx, const char *opt, const char *arg)
 {
     iformat = av_find_input_format(arg);
@@ -3544,6 +3802,12 @@ static const OptionDef real_options[] = {
     { "read_intervals", HAS_ARG, {.func_arg = opt_read_intervals}, "set read intervals", "read_intervals" },
     { "default", HAS_ARG | OPT_AUDIO | OPT_VIDEO | OPT_EXPERT, {.func_arg = opt_default}, "generic catch all option", "" },
     { "i", HAS_ARG, {.func_arg = opt_input_file_i}, "read specified file", "input_file"},
+    { "batch", OPT_STRING | HAS_ARG, {(void*)&batch_list},
+      "probe each input listed in the given file, one per line", "list_file" },
+#if HAVE_THREADS
+    { "batch_threads", OPT_INT | HAS_ARG, {(void*)&batch_threads},
+      "set the number of threads opening the inputs of a batch", "number" },
+#endif
     { "find_stream_info", OPT_BOOL | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
         "read and decode the streams to fill missing information with heuristics" },
     { NULL, },
@@ -3596,8 +3860,13 @@ int main(int argc, char **argv)
     show_banner(argc, argv, options);
     parse_options(NULL, argc, argv, options, opt_input_file);
 
-    if (do_show_log)
+    if (do_show_log) {
         av_log_set_callback(log_callback);
+        // For loging it is needed to disable at least frame threads as otherwise
+        // the log information would need to be reordered and matches up to contexts and frames
+        // That is in fact possible but not trivial
+        av_dict_set(&codec_opts, "threads", "1", 0);
+    }
 
     /* mark things to show, based on -show_entries */
     SET_DO_SHOW(CHAPTERS, chapters);
@@ -3675,14 +3944,20 @@ int main(int argc, char **argv)
         if (w == &xml_writer)
             wctx->string_validation_utf8_flags |= AV_UTF8_FLAG_EXCLUDE_XML_INVALID_CONTROL_CODES;
 
+        if (batch_list) {
+            if (input_filename) {
+                av_log(NULL, AV_LOG_ERROR, "-batch cannot be used with an input file\n");
+                ret = AVERROR(EINVAL);
+            } else {
+                ret = probe_batch(wctx, batch_list);
+            }
+            writer_close(&wctx);
+            goto end;
+        }
+
         writer_print_section_header(wctx, SECTION_ID_ROOT);
 
-        if (do_show_program_version)
-            ffprobe_show_program_version(wctx);
-        if (do_show_library_versions)
-            ffprobe_show_library_versions(wctx);
-        if (do_show_pixel_formats)
-            ffprobe_show_pixel_formats(wctx);
+        show_versions_and_formats(wctx);
 
         if (!input_filename &&
             ((do_show_format || do_show_programs || do_show_streams || do_show_chapters || do_show_packets || do_show_error) ||
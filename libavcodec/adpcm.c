@@ -624,6 +624,24 @@ static int get_nb_samples(AVCodecContext *avctx, GetByteContext *gb,
         *coded_samples = bytestream2_get_le32(gb);
         nb_samples     = (buf_size - (4 + 8 * ch)) * 2 / ch;
         break;
+    case AV_CODEC_ID_ADPCM_IMA_HVQM4:
+    {
+        /* frame format, sample count and an optional per-channel header
+         * whose predictor is output as the first sample */
+        int frame_format = bytestream2_get_be16(gb);
+        header_size = 6;
+        if (frame_format == 1)
+            header_size += 2 * ch;
+        else if (frame_format == 3)
+            header_size += 3 * ch;
+        if (buf_size < header_size)
+            return AVERROR_INVALIDDATA;
+        has_coded_samples  = 1;
+        *coded_samples     = bytestream2_get_be32(gb);
+        nb_samples         = (buf_size - header_size) * 2 / ch + (header_size > 6);
+        *approx_nb_samples = 1;
+        break;
+    }
     case AV_CODEC_ID_ADPCM_EA_MAXIS_XA:
         nb_samples = (buf_size - ch) / ch * 2;
         break;
@@ -894,6 +912,60 @@ static int adpcm_decode_frame(AVCodecContext *avctx, void *data,
         }
         }
         break;
+    case AV_CODEC_ID_ADPCM_IMA_HVQM4:
+    {
+        int frame_format = AV_RB16(buf);
+
+        /* the sample count has already been read */
+        for (channel = 0; channel < avctx->channels; channel++) {
+            cs = &c->status[channel];
+            switch (frame_format) {
+            case 1: /* QuickTime style, top 9 bits of the predictor, 7 bit step index */
+                cs->predictor  = sign_extend(bytestream2_get_be16u(&gb), 16);
+                cs->step_index = cs->predictor & 0x7F;
+                cs->predictor &= ~0x7F;
+                break;
+            case 3: /* separate predictor and step index */
+                cs->predictor  = sign_extend(bytestream2_get_be16u(&gb), 16);
+                cs->step_index = bytestream2_get_byteu(&gb);
+                break;
+            default: /* continues from the previous frame */
+                break;
+            }
+            if (cs->step_index > 88u) {
+                av_log(avctx, AV_LOG_ERROR, "ERROR: step_index[%d] = %i\n",
+                       channel, cs->step_index);
+                return AVERROR_INVALIDDATA;
+            }
+        }
+
+        n = nb_samples;
+        if (frame_format == 1 || frame_format == 3) {
+            for (channel = 0; channel < avctx->channels; channel++)
+                *samples++ = c->status[channel].predictor;
+            n--;
+        }
+
+        /* channels are independent, so stereo decodes both per byte */
+        if (st) {
+            for (; n > 0; n--) {
+                int v = bytestream2_get_byteu(&gb);
+                *samples++ = adpcm_ima_qt_expand_nibble(&c->status[0], v >> 4  , 3);
+                *samples++ = adpcm_ima_qt_expand_nibble(&c->status[1], v & 0x0F, 3);
+            }
+        } else {
+            for (; n > 1; n -= 2) {
+                int v = bytestream2_get_byteu(&gb);
+                *samples++ = adpcm_ima_qt_expand_nibble(&c->status[0], v >> 4  , 3);
+                *samples++ = adpcm_ima_qt_expand_nibble(&c->status[0], v & 0x0F, 3);
+            }
+            if (n)
+                *samples++ = adpcm_ima_qt_expand_nibble(&c->status[0], bytestream2_get_byteu(&gb) >> 4, 3);
+        }
+        /* each packet holds exactly one frame */
+        bytestream2_seek(&gb, 0, SEEK_END);
+        break;
+    }
     case AV_CODEC_ID_ADPCM_4XM:
         for (i = 0; i < avctx->channels; i++)
             c->status[i].predictor = sign_extend(bytestream2_get_le16u(&gb), 16);
@@ -1839,6 +1911,7 @@ ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_DK3,     sample_fmts_s16,  adpcm_ima_dk3,
 ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_DK4,     sample_fmts_s16,  adpcm_ima_dk4,     "ADPCM IMA Duck DK4");
 ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_EA_EACS, sample_fmts_s16,  adpcm_ima_ea_eacs, "ADPCM IMA Electronic Arts EACS");
 ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_EA_SEAD, sample_fmts_s16,  adpcm_ima_ea_sead, "ADPCM IMA Electronic Arts SEAD");
+ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_HVQM4,   sample_fmts_s16,  adpcm_ima_hvqm4,   "ADPCM IMA Hudson HVQM4");
 ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_ISS,     sample_fmts_s16,  adpcm_ima_iss,     "ADPCM IMA Funcom ISS");
 ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_OKI,     sample_fmts_s16,  adpcm_ima_oki,     "ADPCM IMA Dialogic OKI");
 ADPCM_DECODER(AV_CODEC_ID_ADPCM_IMA_QT,      sample_fmts_s16p, adpcm_ima_qt,      "ADPCM IMA QuickTime");
@@ -544,6 +544,7 @@ enum AVCodecID {
     AV_CODEC_ID_ADPCM_IMA_DAT4,
     AV_CODEC_ID_ADPCM_MTAF,
     AV_CODEC_ID_ADPCM_AGM,
+    AV_CODEC_ID_ADPCM_IMA_HVQM4,
 
     /* AMR */
     AV_CODEC_ID_AMR_NB = 0x12000,
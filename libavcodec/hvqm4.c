@@ -21,7 +21,13 @@
 
 #include "avcodec.h"
 #include "internal.h"
+#include "thread.h"
+#include "libavutil/buffer.h"
+#include "libavutil/imgutils.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
 
 #pragma GCC diagnostic ignored "-Wpointer-arith"
 #pragma GCC diagnostic ignored "-Wdeclaration-after-statement"
@@ -33,52 +39,263 @@
 
 typedef struct
 {
+    AVBufferRef *buf;
+    enum AVPictureType pict_type;
+    int64_t pts;
+} Hvqm4Picture;
+
+typedef struct
+{
+    const AVClass *class;
+    int shared_pool;
+
     // TODO: inline Player and SeqObj
     Player player;
+    AVBufferRef *state_buf;
+    AVBufferPool *state_pool;
+
+    // refcounted pictures, handed out to the user without copying
+    AVBufferPool *pool;
+    int frame_size;
+    // anchor frames (I/P), future is the most recently decoded one
+    Hvqm4Picture past;
+    Hvqm4Picture future;
+    // an anchor was skipped, the references are stale until the next I frame
+    int refs_stale;
 } Hvqm4DecodeContext;
 
+enum Hvqm4PoolType {
+    HVQM4_POOL_STATE,
+    HVQM4_POOL_PICTURE,
+};
+
+// pools shared by all decoder instances, keyed on what they hold and the
+// geometry, which the buffer size follows from
+typedef struct
+{
+    enum Hvqm4PoolType type;
+    int width, height;
+    int h_samp, v_samp;
+    unsigned refcount;
+    AVBufferPool *pool;
+} Hvqm4SharedPool;
+
+static AVMutex shared_pools_mutex = AV_MUTEX_INITIALIZER;
+static Hvqm4SharedPool *shared_pools;
+static int nb_shared_pools;
+
+static AVBufferPool *hvqm4_pool_acquire(const SeqObj *seqobj, enum Hvqm4PoolType type,
+                                        int size, int shared)
+{
+    Hvqm4SharedPool *entries;
+    AVBufferPool *pool = NULL;
+    int i;
+
+    if (!shared)
+        return av_buffer_pool_init(size, NULL);
+
+    ff_mutex_lock(&shared_pools_mutex);
+    for (i = 0; i < nb_shared_pools; i++) {
+        Hvqm4SharedPool *entry = &shared_pools[i];
+
+        if (entry->type   == type           &&
+            entry->width  == seqobj->width  &&
+            entry->height == seqobj->height &&
+            entry->h_samp == seqobj->h_samp &&
+            entry->v_samp == seqobj->v_samp) {
+            entry->refcount++;
+            pool = entry->pool;
+            goto end;
+        }
+    }
+    entries = av_realloc_array(shared_pools, nb_shared_pools + 1, sizeof(*shared_pools));
+    if (!entries)
+        goto end;
+    shared_pools = entries;
+    pool = av_buffer_pool_init(size, NULL);
+    if (pool)
+        shared_pools[nb_shared_pools++] = (Hvqm4SharedPool){
+            .type     = type,
+            .width    = seqobj->width,
+            .height   = seqobj->height,
+            .h_samp   = seqobj->h_samp,
+            .v_samp   = seqobj->v_samp,
+            .refcount = 1,
+            .pool     = pool,
+        };
+end:
+    ff_mutex_unlock(&shared_pools_mutex);
+    return pool;
+}
+
+static void hvqm4_pool_release(AVBufferPool **pool, int shared)
+{
+    int i;
+
+    if (!*pool)
+        return;
+    if (!shared) {
+        av_buffer_pool_uninit(pool);
+        return;
+    }
+
+    ff_mutex_lock(&shared_pools_mutex);
+    for (i = 0; i < nb_shared_pools; i++) {
+        if (shared_pools[i].pool == *pool) {
+            // buffers still in use keep the pool alive until they are returned
+            if (!--shared_pools[i].refcount) {
+                av_buffer_pool_uninit(&shared_pools[i].pool);
+                shared_pools[i] = shared_pools[--nb_shared_pools];
+            }
+            break;
+        }
+    }
+    if (!nb_shared_pools)
+        av_freep(&shared_pools);
+    ff_mutex_unlock(&shared_pools_mutex);
+    *pool = NULL;
+}
+
+// allocate the per-thread decoder state, the geometry must be set already
+static av_cold int hvqm4_alloc_state(AVCodecContext *ctx)
+{
+    Hvqm4DecodeContext *h4m = ctx->priv_data;
+    Player *player = &h4m->player;
+    SeqObj *seqobj = &player->seqobj;
+
+    h4m->state_pool = hvqm4_pool_acquire(seqobj, HVQM4_POOL_STATE,
+                                         HVQM4BuffSize(seqobj), h4m->shared_pool);
+    if (!h4m->state_pool)
+        return AVERROR(ENOMEM);
+    h4m->state_buf = av_buffer_pool_get(h4m->state_pool);
+    if (!h4m->state_buf)
+        return AVERROR(ENOMEM);
+    HVQM4SetBuffer(seqobj, h4m->state_buf->data);
+    decv_init(player);
+    // pictures are managed by the buffer pool instead
+    free(player->past);
+    free(player->present);
+    free(player->future);
+    player->past = player->present = player->future = NULL;
+
+    h4m->pool = hvqm4_pool_acquire(seqobj, HVQM4_POOL_PICTURE,
+                                   h4m->frame_size, h4m->shared_pool);
+    if (!h4m->pool)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static AVOnce hvqm4_init_static_once = AV_ONCE_INIT;
+
 static av_cold int hvqm4_init(AVCodecContext *ctx)
 {
     av_log(ctx, AV_LOG_DEBUG, "hvqm4_init\n");
     Hvqm4DecodeContext *h4m = ctx->priv_data;
     Player *player = &h4m->player;
     SeqObj *seqobj = &player->seqobj;
+    int ret;
 
-    HVQM4InitDecoder();
+    // the core's tables are shared by all instances
+    ret = ff_thread_once(&hvqm4_init_static_once, &HVQM4InitDecoder);
+    if (ret != 0)
+        return AVERROR_UNKNOWN;
+    if ((ret = av_image_check_size(ctx->width, ctx->height, 0, ctx)) < 0)
+        return ret;
+    if (ctx->width > UINT16_MAX || ctx->height > UINT16_MAX)
+        return AVERROR_INVALIDDATA;
     seqobj->width = ctx->width;
     seqobj->height = ctx->height;
     if (ctx->extradata_size < 2)
         return AVERROR_INVALIDDATA;
     seqobj->h_samp = ctx->extradata[0];
     seqobj->v_samp = ctx->extradata[1];
-    VideoState *state = malloc(HVQM4BuffSize(seqobj));
-    HVQM4SetBuffer(seqobj, state);
-    decv_init(player);
 
+    // chroma subsampling factors
     if (seqobj->h_samp == 2 && seqobj->v_samp == 2)
         ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    else if (seqobj->h_samp == 2 && seqobj->v_samp == 1)
+        ctx->pix_fmt = AV_PIX_FMT_YUV422P;
+    else if (seqobj->h_samp == 1 && seqobj->v_samp == 2)
+        ctx->pix_fmt = AV_PIX_FMT_YUV440P;
+    else if (seqobj->h_samp == 1 && seqobj->v_samp == 1)
+        ctx->pix_fmt = AV_PIX_FMT_YUV444P;
     else {
         av_log(ctx, AV_LOG_ERROR, "pixel format not implemented: h_samp:%u v_samp:%u\n", seqobj->h_samp, seqobj->v_samp);
         return AVERROR_PATCHWELCOME;
     }
     ctx->color_range = AVCOL_RANGE_JPEG; // just a guess
+    // anchors are output after the B frames that precede them in display order
+    ctx->has_b_frames = 1;
+
+    // the decoder core works on contiguous planes without padding
+    h4m->frame_size = av_image_get_buffer_size(ctx->pix_fmt, ctx->width, ctx->height, 1);
+    if (h4m->frame_size < 0)
+        return h4m->frame_size;
+
+    return hvqm4_alloc_state(ctx);
+}
+
+#if HAVE_THREADS
+static av_cold int hvqm4_init_thread_copy(AVCodecContext *ctx)
+{
+    Hvqm4DecodeContext *h4m = ctx->priv_data;
+
+    // only the geometry may be shared with the first thread
+    h4m->player.seqobj.state = NULL;
+    h4m->state_buf = NULL;
+    h4m->state_pool = NULL;
+    h4m->pool = NULL;
+    h4m->past.buf = NULL;
+    h4m->future.buf = NULL;
+
+    return hvqm4_alloc_state(ctx);
+}
+
+static int hvqm4_update_thread_context(AVCodecContext *dst, const AVCodecContext *src)
+{
+    Hvqm4DecodeContext *h4m = dst->priv_data;
+    const Hvqm4DecodeContext *h4m_src = src->priv_data;
+
+    if (dst == src)
+        return 0;
+
+    av_buffer_unref(&h4m->past.buf);
+    av_buffer_unref(&h4m->future.buf);
+    h4m->past.pict_type = h4m_src->past.pict_type;
+    h4m->future.pict_type = h4m_src->future.pict_type;
+    h4m->past.pts = h4m_src->past.pts;
+    h4m->future.pts = h4m_src->future.pts;
+    h4m->refs_stale = h4m_src->refs_stale;
+    if (h4m_src->past.buf && !(h4m->past.buf = av_buffer_ref(h4m_src->past.buf)))
+        return AVERROR(ENOMEM);
+    if (h4m_src->future.buf && !(h4m->future.buf = av_buffer_ref(h4m_src->future.buf)))
+        return AVERROR(ENOMEM);
 
     return 0;
 }
+#endif
 
 static av_cold int hvqm4_close(AVCodecContext *ctx)
 {
     Hvqm4DecodeContext *h4m = ctx->priv_data;
-    free(h4m->player.past);
-    free(h4m->player.present);
-    free(h4m->player.future);
-    free(h4m->player.seqobj.state);
+    av_buffer_unref(&h4m->past.buf);
+    av_buffer_unref(&h4m->future.buf);
+    hvqm4_pool_release(&h4m->pool, h4m->shared_pool);
+    av_buffer_unref(&h4m->state_buf);
+    hvqm4_pool_release(&h4m->state_pool, h4m->shared_pool);
+    h4m->player.seqobj.state = NULL;
     return 0;
 }
 
-static int hvqm4_flush(AVCodecContext *ctx)
+static void hvqm4_flush(AVCodecContext *ctx)
 {
-    return 0;
+    Hvqm4DecodeContext *h4m = ctx->priv_data;
+
+    // P and B frames are dropped until the next I frame
+    av_buffer_unref(&h4m->past.buf);
+    av_buffer_unref(&h4m->future.buf);
+    h4m->refs_stale = 0;
 }
 
 enum Hvqm4FrameType
@@ -88,6 +305,28 @@ enum Hvqm4FrameType
     HVQM4_B_FRAME = 0x30,
 };
 
+// export a decoded picture as the frame's only buffer
+static int hvqm4_output_picture(AVCodecContext *ctx, AVFrame *frame, AVBufferRef *pic)
+{
+    int ret;
+
+    if ((ret = ff_decode_frame_props(ctx, frame)) < 0)
+        return ret;
+    frame->width  = ctx->width;
+    frame->height = ctx->height;
+    frame->format = ctx->pix_fmt;
+    frame->buf[0] = av_buffer_ref(pic);
+    if (!frame->buf[0])
+        return AVERROR(ENOMEM);
+    ret = av_image_fill_arrays(frame->data, frame->linesize, pic->data,
+                               ctx->pix_fmt, ctx->width, ctx->height, 1);
+    if (ret < 0) {
+        av_buffer_unref(&frame->buf[0]);
+        return ret;
+    }
+    return 0;
+}
+
 static int hvqm4_decode(AVCodecContext *ctx, void *data, int *got_frame, AVPacket *pkt)
 {
     //av_log(ctx, AV_LOG_DEBUG, "hvqm4_decode\n");
@@ -95,84 +334,158 @@ static int hvqm4_decode(AVCodecContext *ctx, void *data, int *got_frame, AVPacke
     AVFrame *frame = data;
     Player *player = &h4m->player;
     SeqObj *seqobj = &player->seqobj;
+    Hvqm4Picture present;
+    const Hvqm4Picture *output;
     int ret;
 
-    uint16_t frame_type = AV_RB16(pkt->data);
-    // FIXME: pts is GOP relative but should be global
-    frame->pts = pkt->pts = AV_RB32(pkt->data + 2);
-
-    //TODO: AV_GET_BUFFER_FLAG_REF
-    if ((ret = ff_reget_buffer(ctx, frame, 0)) < 0)
-        return ret;
-    frame->pts = pkt->pts;
+    // draining, return the anchor that is still held back
+    if (!pkt->size) {
+        if (!h4m->future.buf)
+            return 0;
+        if ((ret = hvqm4_output_picture(ctx, frame, h4m->future.buf)) < 0)
+            return ret;
+        frame->pts = h4m->future.pts;
+        frame->pict_type = h4m->future.pict_type;
+        frame->key_frame = frame->pict_type == AV_PICTURE_TYPE_I;
+        av_buffer_unref(&h4m->future.buf);
+        *got_frame = 1;
+        return 0;
+    }
 
-    if (frame_type != HVQM4_B_FRAME)
-        FFSWAP(void *, player->past, player->future);
+    // frame type and display order, followed by the picture data
+    if (pkt->size < 6) {
+        av_log(ctx, AV_LOG_ERROR, "packet too small\n");
+        return AVERROR_INVALIDDATA;
+    }
+    uint16_t frame_type = AV_RB16(pkt->data);
+    present.pts = pkt->pts;
 
     switch (frame_type)
     {
         case HVQM4_I_FRAME:
-            av_log(ctx, AV_LOG_DEBUG, "I frame pts:%u,%u\n", frame->pts, pkt->pts);
-            HVQM4DecodeIpic(seqobj, pkt->data + 6, player->present);
-            frame->pict_type = AV_PICTURE_TYPE_I;
+            present.pict_type = AV_PICTURE_TYPE_I;
+            if (ctx->skip_frame >= AVDISCARD_ALL)
+                goto discard;
+            h4m->refs_stale = 0;
             break;
         case HVQM4_P_FRAME:
-            av_log(ctx, AV_LOG_DEBUG, "P frame pts:%u,%u\n", frame->pts, pkt->pts);
-            HVQM4DecodePpic(seqobj, pkt->data + 6, player->present, player->past);
-            frame->pict_type = AV_PICTURE_TYPE_P;
+            present.pict_type = AV_PICTURE_TYPE_P;
+            if (ctx->skip_frame >= AVDISCARD_NONINTRA) {
+                h4m->refs_stale = 1;
+                goto discard;
+            }
+            if (!h4m->future.buf || h4m->refs_stale)
+                goto skip;
             break;
         case HVQM4_B_FRAME:
-            av_log(ctx, AV_LOG_DEBUG, "B frame pts:%u,%u\n", frame->pts, pkt->pts);
-            HVQM4DecodeBpic(seqobj, pkt->data + 6, player->present, player->past, player->future);
-            frame->pict_type = AV_PICTURE_TYPE_B;
+            present.pict_type = AV_PICTURE_TYPE_B;
+            // B frames are never used as references
+            if (ctx->skip_frame >= AVDISCARD_NONREF)
+                goto discard;
+            if (!h4m->past.buf || !h4m->future.buf || h4m->refs_stale)
+                goto skip;
             break;
         default:
             av_log(ctx, AV_LOG_ERROR, "unknown frame type\n");
             return AVERROR_INVALIDDATA;
     }
-    frame->key_frame = frame->pict_type == AV_PICTURE_TYPE_I;
 
-    if (frame_type != HVQM4_B_FRAME)
-        FFSWAP(void *, player->present, player->future);
+    // B frames are never referenced, so the next frame can be set up while
+    // this one is decoded; anchors are only handed on once complete
+    if (frame_type == HVQM4_B_FRAME)
+        ff_thread_finish_setup(ctx);
 
-    if (pkt->dts > 0)
-    {
-        // FIXME: ffmpeg doesn't guarantee that the planes are contiguous, so I
-        // decode them internally and then copy the planes into their respective
-        // pointers, fixing this will require changing the hvqm4-internal functions
-        uint8_t *ptr;
-        if (frame_type == HVQM4_B_FRAME)
-            ptr = player->present;
-        else
-            ptr = player->past;
-
-        size_t y_plane_size = frame->width * frame->height;
-        size_t uv_plane_size = y_plane_size / 4;
-        memcpy(frame->data[0], ptr, y_plane_size); ptr += y_plane_size;
-        memcpy(frame->data[1], ptr, uv_plane_size); ptr += uv_plane_size;
-        memcpy(frame->data[2], ptr, uv_plane_size);
+    // every picture gets a fresh buffer, pictures still held by the user
+    // are never written to
+    present.buf = av_buffer_pool_get(h4m->pool);
+    if (!present.buf)
+        return AVERROR(ENOMEM);
 
-        *got_frame = 1;
+    if (frame_type != HVQM4_B_FRAME) {
+        av_buffer_unref(&h4m->past.buf);
+        h4m->past = h4m->future;
+        h4m->future.buf = NULL;
     }
-    else
+
+    switch (frame_type)
     {
-        *got_frame = 0;
+        case HVQM4_I_FRAME:
+            av_log(ctx, AV_LOG_DEBUG, "I frame pts:%"PRId64"\n", present.pts);
+            HVQM4DecodeIpic(seqobj, pkt->data + 6, present.buf->data);
+            break;
+        case HVQM4_P_FRAME:
+            av_log(ctx, AV_LOG_DEBUG, "P frame pts:%"PRId64"\n", present.pts);
+            HVQM4DecodePpic(seqobj, pkt->data + 6, present.buf->data, h4m->past.buf->data);
+            break;
+        case HVQM4_B_FRAME:
+            av_log(ctx, AV_LOG_DEBUG, "B frame pts:%"PRId64"\n", present.pts);
+            HVQM4DecodeBpic(seqobj, pkt->data + 6, present.buf->data,
+                            h4m->past.buf->data, h4m->future.buf->data);
+            break;
+    }
+
+    // B frames are output right away, anchors once the next anchor arrives
+    if (frame_type != HVQM4_B_FRAME) {
+        h4m->future = present;
+        output = &h4m->past;
+        ff_thread_finish_setup(ctx);
+    } else {
+        output = &present;
     }
 
+    *got_frame = 0;
+    ret = pkt->size;
+    if (output->buf) {
+        if ((ret = hvqm4_output_picture(ctx, frame, output->buf)) >= 0) {
+            frame->pts = output->pts;
+            frame->pict_type = output->pict_type;
+            frame->key_frame = frame->pict_type == AV_PICTURE_TYPE_I;
+            *got_frame = 1;
+            ret = pkt->size;
+        }
+    }
+
+    if (frame_type == HVQM4_B_FRAME)
+        av_buffer_unref(&present.buf);
+
+    return ret;
+
+skip:
+    // after a flush or at the start of a stream cut in the middle of a GOP
+    av_log(ctx, AV_LOG_DEBUG, "skipping frame without reference\n");
+discard:
+    *got_frame = 0;
     return pkt->size;
 }
 
+#define OFFSET(x) offsetof(Hvqm4DecodeContext, x)
+#define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
+static const AVOption hvqm4_options[] = {
+    { "shared_pool", "share picture and state buffers with other decoders of the same geometry",
+      OFFSET(shared_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, VD },
+    { NULL },
+};
+
+static const AVClass hvqm4_decoder_class = {
+    .class_name = "hvqm4 decoder",
+    .item_name  = av_default_item_name,
+    .option     = hvqm4_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVCodec ff_hvqm4_decoder = {
     .name = "hvqm4",
     .long_name = NULL_IF_CONFIG_SMALL("Hudson HVQM4 video"),
     .type = AVMEDIA_TYPE_VIDEO,
     .id = AV_CODEC_ID_HVQM4,
-    .capabilities = 0,
+    .capabilities = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_FRAME_THREADS,
     .priv_data_size = sizeof(Hvqm4DecodeContext),
     .init = hvqm4_init,
     .close = hvqm4_close,
     .decode = hvqm4_decode,
-    // FIXME: this is supposedly used for seeking
-    //.flush = hvqm4_flush,
-    .caps_internal = 0,
+    .init_thread_copy = ONLY_IF_THREADS_ENABLED(hvqm4_init_thread_copy),
+    .update_thread_context = ONLY_IF_THREADS_ENABLED(hvqm4_update_thread_context),
+    .flush = hvqm4_flush,
+    .caps_internal = FF_CODEC_CAP_INIT_THREADSAFE | FF_CODEC_CAP_INIT_CLEANUP,
+    .priv_class = &hvqm4_decoder_class,
 };
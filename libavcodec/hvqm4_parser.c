@@ -0,0 +1,149 @@
+/*
+ * HVQM4 video parser
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * HVQM4 video parser
+ *
+ * Splits a stream of frame records as stored in .h4m files (media type,
+ * frame type, payload size, payload) into decoder packets (frame type,
+ * payload), one per video frame. Audio records are dropped. Complete
+ * frames are expected to hold one record each.
+ */
+
+#include "libavutil/intreadwrite.h"
+#include "parser.h"
+
+#define HVQM4_RECORD_HEADER_SIZE 8
+
+typedef struct HVQM4ParseContext {
+    ParseContext pc;
+    uint64_t header;
+    int header_bytes;
+    uint32_t remaining;
+    uint8_t *out;
+    unsigned int out_size;
+} HVQM4ParseContext;
+
+static int hvqm4_find_frame_end(HVQM4ParseContext *s, const uint8_t *buf, int buf_size)
+{
+    int i = 0;
+
+    while (i < buf_size) {
+        if (s->remaining) {
+            uint32_t n = FFMIN(s->remaining, buf_size - i);
+            i            += n;
+            s->remaining -= n;
+            if (!s->remaining)
+                return i;
+        } else {
+            s->header = s->header << 8 | buf[i++];
+            if (++s->header_bytes == HVQM4_RECORD_HEADER_SIZE) {
+                s->header_bytes = 0;
+                s->remaining    = s->header & 0xFFFFFFFF;
+                if (!s->remaining)
+                    return i;
+            }
+        }
+    }
+
+    return END_NOT_FOUND;
+}
+
+static void hvqm4_set_frame_props(AVCodecParserContext *s1, int frame_type)
+{
+    switch (frame_type) {
+    case 0x10:
+        s1->pict_type = AV_PICTURE_TYPE_I;
+        s1->key_frame = 1;
+        break;
+    case 0x20:
+        s1->pict_type = AV_PICTURE_TYPE_P;
+        s1->key_frame = 0;
+        break;
+    case 0x30:
+        s1->pict_type = AV_PICTURE_TYPE_B;
+        s1->key_frame = 0;
+        break;
+    default:
+        s1->pict_type = AV_PICTURE_TYPE_NONE;
+        s1->key_frame = -1;
+    }
+}
+
+static int hvqm4_parse(AVCodecParserContext *s1, AVCodecContext *avctx,
+                       const uint8_t **poutbuf, int *poutbuf_size,
+                       const uint8_t *buf, int buf_size)
+{
+    HVQM4ParseContext *s = s1->priv_data;
+    ParseContext *pc = &s->pc;
+    int next, frame_type;
+    uint32_t size;
+
+    if (s1->flags & PARSER_FLAG_COMPLETE_FRAMES) {
+        next = buf_size;
+    } else {
+        next = hvqm4_find_frame_end(s, buf, buf_size);
+        if (ff_combine_frame(pc, next, &buf, &buf_size) < 0) {
+            *poutbuf      = NULL;
+            *poutbuf_size = 0;
+            return buf_size;
+        }
+    }
+
+    *poutbuf      = NULL;
+    *poutbuf_size = 0;
+
+    // audio records are dropped, as are truncated ones
+    if (buf_size < HVQM4_RECORD_HEADER_SIZE || AV_RB16(buf) != 1)
+        return next;
+    frame_type = AV_RB16(buf + 2);
+    size       = AV_RB32(buf + 4);
+    if (size > buf_size - HVQM4_RECORD_HEADER_SIZE)
+        return next;
+
+    // the decoder expects the frame type right in front of the payload
+    av_fast_padded_malloc(&s->out, &s->out_size, size + 2);
+    if (!s->out)
+        return next;
+    AV_WB16(s->out, frame_type);
+    memcpy(s->out + 2, buf + HVQM4_RECORD_HEADER_SIZE, size);
+
+    hvqm4_set_frame_props(s1, frame_type);
+
+    *poutbuf      = s->out;
+    *poutbuf_size = size + 2;
+    return next;
+}
+
+static void hvqm4_parse_close(AVCodecParserContext *s1)
+{
+    HVQM4ParseContext *s = s1->priv_data;
+
+    av_freep(&s->out);
+    ff_parse_close(s1);
+}
+
+AVCodecParser ff_hvqm4_parser = {
+    .codec_ids      = { AV_CODEC_ID_HVQM4 },
+    .priv_data_size = sizeof(HVQM4ParseContext),
+    .parser_parse   = hvqm4_parse,
+    .parser_close   = hvqm4_parse_close,
+};
@@ -0,0 +1,139 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * This bitstream filter splits packets of HVQM4 frame records as stored in
+ * .h4m files (media type, frame type, payload size, payload) into decoder
+ * packets containing one video frame each (frame type, payload).
+ */
+
+#include "libavutil/intreadwrite.h"
+
+#include "avcodec.h"
+#include "bsf.h"
+
+#define HVQM4_RECORD_HEADER_SIZE 8
+
+typedef struct HVQM4SplitContext {
+    AVPacket *buffer_pkt;
+    int offset;
+    int nb_frames;
+} HVQM4SplitContext;
+
+static int hvqm4_split_filter(AVBSFContext *ctx, AVPacket *out)
+{
+    HVQM4SplitContext *s = ctx->priv_data;
+    AVPacket *in = s->buffer_pkt;
+    int media_type, frame_type, ret;
+    uint32_t size;
+    const uint8_t *rec;
+
+    while (1) {
+        if (!in->data) {
+            ret = ff_bsf_get_packet_ref(ctx, in);
+            if (ret < 0)
+                return ret;
+            s->offset    = 0;
+            s->nb_frames = 0;
+        }
+
+        if (in->size - s->offset < HVQM4_RECORD_HEADER_SIZE) {
+            if (s->offset < in->size)
+                av_log(ctx, AV_LOG_WARNING, "Discarding %d trailing bytes\n",
+                       in->size - s->offset);
+            av_packet_unref(in);
+            continue;
+        }
+
+        rec        = in->data + s->offset;
+        media_type = AV_RB16(rec);
+        frame_type = AV_RB16(rec + 2);
+        size       = AV_RB32(rec + 4);
+        if (size > in->size - s->offset - HVQM4_RECORD_HEADER_SIZE) {
+            av_log(ctx, AV_LOG_ERROR, "Invalid frame record size %u\n", size);
+            ret = AVERROR_INVALIDDATA;
+            goto fail;
+        }
+        s->offset += HVQM4_RECORD_HEADER_SIZE + size;
+
+        // audio records are dropped
+        if (media_type != 1)
+            continue;
+
+        // each frame gets its own buffer, so that its padding is zeroed
+        ret = av_new_packet(out, size + 2);
+        if (ret < 0)
+            goto fail;
+        ret = av_packet_copy_props(out, in);
+        if (ret < 0) {
+            av_packet_unref(out);
+            goto fail;
+        }
+        AV_WB16(out->data, frame_type);
+        memcpy(out->data + 2, rec + HVQM4_RECORD_HEADER_SIZE, size);
+        if (frame_type == 0x10)
+            out->flags |= AV_PKT_FLAG_KEY;
+        else
+            out->flags &= ~AV_PKT_FLAG_KEY;
+        // timestamps belong to the first frame only
+        if (s->nb_frames++) {
+            out->pts = out->dts = AV_NOPTS_VALUE;
+            out->duration = 0;
+        }
+
+        return 0;
+    }
+
+fail:
+    av_packet_unref(in);
+    return ret;
+}
+
+static int hvqm4_split_init(AVBSFContext *ctx)
+{
+    HVQM4SplitContext *s = ctx->priv_data;
+
+    s->buffer_pkt = av_packet_alloc();
+    if (!s->buffer_pkt)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static void hvqm4_split_flush(AVBSFContext *ctx)
+{
+    HVQM4SplitContext *s = ctx->priv_data;
+    av_packet_unref(s->buffer_pkt);
+}
+
+static void hvqm4_split_close(AVBSFContext *ctx)
+{
+    HVQM4SplitContext *s = ctx->priv_data;
+    av_packet_free(&s->buffer_pkt);
+}
+
+const AVBitStreamFilter ff_hvqm4_split_bsf = {
+    .name           = "hvqm4_split",
+    .priv_data_size = sizeof(HVQM4SplitContext),
+    .init           = hvqm4_split_init,
+    .flush          = hvqm4_split_flush,
+    .close          = hvqm4_split_close,
+    .filter         = hvqm4_split_filter,
+    .codec_ids      = (const enum AVCodecID []){ AV_CODEC_ID_HVQM4, AV_CODEC_ID_NONE },
+};
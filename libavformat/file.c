@@ -19,9 +19,20 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+
+#define FILE_READAHEAD (HAVE_THREADS && HAVE_PREAD)
+
+#if FILE_READAHEAD
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE // for O_DIRECT
+# endif
+#endif
+
 #include "libavutil/avstring.h"
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "avformat.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -67,6 +78,27 @@
 
 /* standard file protocol */
 
+#if FILE_READAHEAD
+/* alignment of the read-ahead buffers, offsets and sizes, as direct I/O needs */
+#define DIRECT_IO_ALIGN 4096
+
+enum ReadAheadState {
+    BLOCK_EMPTY,
+    BLOCK_QUEUED,               ///< waiting for a thread to read it
+    BLOCK_READING,
+    BLOCK_READY,
+};
+
+typedef struct ReadAheadBlock {
+    uint8_t *buf;
+    uint8_t *data;              ///< buf aligned to DIRECT_IO_ALIGN
+    int64_t pos;                ///< file offset of the block
+    int size;                   ///< number of bytes read
+    int error;                  ///< AVERROR code if the read failed after size bytes
+    enum ReadAheadState state;
+} ReadAheadBlock;
+#endif
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -74,9 +106,24 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int readahead_depth;
+    int readahead_block_size;
+    int readahead_threads;
+    int direct;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
+#if FILE_READAHEAD
+    /* ring of readahead_depth blocks, the block at offset pos is at
+     * index (pos / readahead_block_size) % readahead_depth */
+    ReadAheadBlock *blocks;
+    pthread_t *threads;
+    int nb_threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int abort;
+    int64_t pos;                ///< read position
+#endif
 } FileContext;
 
 static const AVOption file_options[] = {
@@ -84,6 +131,10 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "readahead_depth", "set the number of blocks read concurrently ahead of the read position", offsetof(FileContext, readahead_depth), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, AV_OPT_FLAG_DECODING_PARAM },
+    { "readahead_block_size", "set the size of the blocks read ahead", offsetof(FileContext, readahead_block_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, 1 << 28, AV_OPT_FLAG_DECODING_PARAM },
+    { "readahead_threads", "set the maximum number of threads reading ahead", offsetof(FileContext, readahead_threads), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, 64, AV_OPT_FLAG_DECODING_PARAM },
+    { "direct", "bypass the page cache when reading ahead", offsetof(FileContext, direct), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -106,11 +157,214 @@ static const AVClass pipe_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if FILE_READAHEAD
+static void *readahead_thread(void *arg)
+{
+    FileContext *c = arg;
+    int bs = c->readahead_block_size;
+
+    pthread_mutex_lock(&c->mutex);
+    while (!c->abort) {
+        ReadAheadBlock *block = NULL;
+        int64_t pos;
+        int i, ret, size = 0, error = 0;
+
+        /* the queued block closest to the read position first */
+        for (i = 0; i < c->readahead_depth; i++)
+            if (c->blocks[i].state == BLOCK_QUEUED &&
+                (!block || c->blocks[i].pos < block->pos))
+                block = &c->blocks[i];
+        if (!block) {
+            pthread_cond_wait(&c->cond, &c->mutex);
+            continue;
+        }
+        block->state = BLOCK_READING;
+        pos = block->pos;
+        pthread_mutex_unlock(&c->mutex);
+
+        while (size < bs) {
+            ret = pread(c->fd, block->data + size, bs - size, pos + size);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0)
+                error = AVERROR(errno);
+            if (ret <= 0)
+                break;
+            size += ret;
+            // reading on at an unaligned offset fails with direct I/O on
+            // some file systems, so such a short read has to end the file
+            if (c->direct && size % DIRECT_IO_ALIGN) {
+                struct stat st;
+
+                if (fstat(c->fd, &st) < 0)
+                    error = AVERROR(errno);
+                else if (pos + size < st.st_size)
+                    error = AVERROR(EIO);
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&c->mutex);
+        block->size  = size;
+        block->error = error;
+        block->state = BLOCK_READY;
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+/* queue the blocks from the one containing the read position on,
+ * must be called with the mutex locked */
+static void readahead_schedule(FileContext *c)
+{
+    int64_t bs  = c->readahead_block_size;
+    int64_t pos = c->pos - c->pos % bs;
+    int i, queued = 0;
+
+    for (i = 0; i < c->readahead_depth; i++, pos += bs) {
+        ReadAheadBlock *block = &c->blocks[pos / bs % c->readahead_depth];
+
+        if (block->pos == pos && block->state != BLOCK_EMPTY)
+            continue;
+        /* a block still being read for an earlier position
+         * is reused on a later call */
+        if (block->state == BLOCK_READING)
+            continue;
+        block->pos   = pos;
+        block->state = BLOCK_QUEUED;
+        queued = 1;
+    }
+    if (queued)
+        pthread_cond_broadcast(&c->cond);
+}
+
+static int readahead_read(URLContext *h, unsigned char *buf, int size)
+{
+    FileContext *c = h->priv_data;
+    int64_t bs = c->readahead_block_size;
+    ReadAheadBlock *block;
+    int offset, ret;
+
+    pthread_mutex_lock(&c->mutex);
+    while (1) {
+        readahead_schedule(c);
+        block = &c->blocks[c->pos / bs % c->readahead_depth];
+        if (block->state == BLOCK_READY && block->pos == c->pos - c->pos % bs)
+            break;
+        pthread_cond_wait(&c->cond, &c->mutex);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    /* the threads leave ready blocks alone, no need to hold the lock */
+    offset = c->pos - block->pos;
+    if (block->size > offset) {
+        ret = FFMIN(size, block->size - offset);
+        memcpy(buf, block->data + offset, ret);
+        c->pos += ret;
+        return ret;
+    }
+
+    /* an error is only returned once the data read before it is consumed */
+    ret = block->error ? block->error : AVERROR_EOF;
+    /* read the block again next time, the file may have grown meanwhile */
+    pthread_mutex_lock(&c->mutex);
+    block->state = BLOCK_EMPTY;
+    pthread_mutex_unlock(&c->mutex);
+    return ret;
+}
+
+static void readahead_free(FileContext *c)
+{
+    int i;
+
+    if (!c->blocks)
+        return;
+
+    if (c->threads) {
+        pthread_mutex_lock(&c->mutex);
+        c->abort = 1;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->mutex);
+        for (i = 0; i < c->nb_threads; i++)
+            pthread_join(c->threads[i], NULL);
+        av_freep(&c->threads);
+        pthread_cond_destroy(&c->cond);
+        pthread_mutex_destroy(&c->mutex);
+    }
+    for (i = 0; i < c->readahead_depth; i++)
+        av_freep(&c->blocks[i].buf);
+    av_freep(&c->blocks);
+}
+
+static int readahead_init(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    int i, nb_threads, ret;
+
+    c->blocks = av_mallocz_array(c->readahead_depth, sizeof(*c->blocks));
+    if (!c->blocks)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < c->readahead_depth; i++) {
+        ReadAheadBlock *block = &c->blocks[i];
+
+        block->buf = av_malloc(c->readahead_block_size + DIRECT_IO_ALIGN - 1);
+        if (!block->buf) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        block->data = (uint8_t *)FFALIGN((uintptr_t)block->buf, DIRECT_IO_ALIGN);
+    }
+
+    nb_threads = FFMIN(c->readahead_depth, c->readahead_threads);
+    c->threads = av_malloc_array(nb_threads, sizeof(*c->threads));
+    if (!c->threads) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    if ((ret = pthread_mutex_init(&c->mutex, NULL))) {
+        av_freep(&c->threads);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_cond_init(&c->cond, NULL))) {
+        pthread_mutex_destroy(&c->mutex);
+        av_freep(&c->threads);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    /* each thread keeps one read in flight, the other queued blocks
+     * wait for the first thread done */
+    for (i = 0; i < nb_threads; i++) {
+        if ((ret = pthread_create(&c->threads[i], NULL, readahead_thread, c))) {
+            av_log(h, AV_LOG_WARNING, "pthread_create failed: %s\n", av_err2str(AVERROR(ret)));
+            break;
+        }
+        c->nb_threads++;
+    }
+    if (!c->nb_threads) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    readahead_free(c);
+    return ret;
+}
+#endif
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+#if FILE_READAHEAD
+    if (c->blocks)
+        return readahead_read(h, buf, size);
+#endif
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -210,6 +464,7 @@ static int file_open(URLContext *h, const char *filename, int flags)
     FileContext *c = h->priv_data;
     int access;
     int fd;
+    int have_stat;
     struct stat st;
 
     av_strstart(filename, "file:", &filename);
@@ -228,12 +483,43 @@ static int file_open(URLContext *h, const char *filename, int flags)
 #ifdef O_BINARY
     access |= O_BINARY;
 #endif
+    if (c->direct) {
+#if FILE_READAHEAD && defined(O_DIRECT)
+        if (!c->readahead_depth || flags & AVIO_FLAG_WRITE ||
+            c->readahead_block_size % DIRECT_IO_ALIGN) {
+            av_log(h, AV_LOG_ERROR, "Direct I/O needs read-only access, readahead_depth "
+                   "and a readahead_block_size multiple of %d\n", DIRECT_IO_ALIGN);
+            return AVERROR(EINVAL);
+        }
+        access |= O_DIRECT;
+#else
+        av_log(h, AV_LOG_ERROR, "Direct I/O is not supported\n");
+        return AVERROR(ENOSYS);
+#endif
+    }
     fd = avpriv_open(filename, access, 0666);
     if (fd == -1)
         return AVERROR(errno);
     c->fd = fd;
 
-    h->is_streamed = !fstat(fd, &st) && S_ISFIFO(st.st_mode);
+    have_stat = !fstat(fd, &st);
+    h->is_streamed = have_stat && S_ISFIFO(st.st_mode);
+
+#if FILE_READAHEAD
+    if (c->readahead_depth && !(flags & AVIO_FLAG_WRITE) && !c->follow && have_stat &&
+        (S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+        int ret = readahead_init(h);
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+    } else
+#endif
+    if (c->direct) {
+        av_log(h, AV_LOG_ERROR, "Direct I/O is not possible with this file\n");
+        close(fd);
+        return AVERROR(EINVAL);
+    }
 
     /* Buffer writes more than the default 32k to improve throughput especially
      * with networked file systems */
@@ -258,6 +544,25 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+#if FILE_READAHEAD
+    /* the file offset is not used by the read-ahead threads */
+    if (c->blocks) {
+        struct stat st;
+        if (whence == SEEK_CUR) {
+            pos += c->pos;
+        } else if (whence == SEEK_END) {
+            if (fstat(c->fd, &st) < 0)
+                return AVERROR(errno);
+            pos += st.st_size;
+        } else if (whence != SEEK_SET) {
+            return AVERROR(EINVAL);
+        }
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->pos = pos;
+    }
+#endif
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -266,6 +571,9 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
+#if FILE_READAHEAD
+    readahead_free(c);
+#endif
     return close(c->fd);
 }
 
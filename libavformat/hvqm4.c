@@ -1,5 +1,5 @@
 /*
- * HVQM4 Demuxer
+ * HVQM4 demuxer and muxer
  * Copyright (c) 2019 Tillmann Karras
  *
  * This file is part of FFmpeg.
@@ -19,21 +19,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/intreadwrite.h"
+#include "libavutil/opt.h"
+#include "libavutil/avassert.h"
 #include "avformat.h"
 #include "avio.h"
+#include "avio_internal.h"
 #include "internal.h"
 
-// FIXME: enable these warnings
-#pragma GCC diagnostic ignored "-Wdeclaration-after-statement"
-#pragma GCC diagnostic ignored "-Wunused-variable"
-
 #define HVQM4_MAGIC_SIZE 16
+#define HVQM4_FILE_HEADER_SIZE 0x44
+#define HVQM4_GOP_HEADER_SIZE 20
 
+#if CONFIG_HVQM4_DEMUXER
 static int hvqm4_read_probe(const AVProbeData *p)
 {
-    av_log(NULL, AV_LOG_TRACE, "hvqm4_read_probe\n");
-    const char magic13[HVQM4_MAGIC_SIZE] = "HVQM4 1.3";
-    const char magic15[HVQM4_MAGIC_SIZE] = "HVQM4 1.5";
+    static const char magic13[HVQM4_MAGIC_SIZE] = "HVQM4 1.3";
+    static const char magic15[HVQM4_MAGIC_SIZE] = "HVQM4 1.5";
+
     if (memcmp(p->buf, magic13, HVQM4_MAGIC_SIZE) == 0)
         return AVPROBE_SCORE_MAX;
     if (memcmp(p->buf, magic15, HVQM4_MAGIC_SIZE) == 0)
@@ -43,6 +46,17 @@ static int hvqm4_read_probe(const AVProbeData *p)
 
 typedef struct
 {
+    int64_t pos;
+    // number of video frames in all preceding GOPs
+    uint32_t video_frames_before;
+} Hvqm4GopEntry;
+
+typedef struct
+{
+    const AVClass *class;
+    int gop_readahead;
+    int export_frame_info;
+
     // these headers are sparse
     struct FileHeader
     {
@@ -61,49 +75,82 @@ typedef struct
 
     int video_stream_index;
     int audio_stream_index;
+    uint32_t frame_usec;
+    uint32_t audio_sample_rate;
 
     // current position
     int64_t gop_start;
     uint32_t gop_index;
     uint32_t gop_video_index;
     uint32_t gop_audio_index;
-    uint32_t video_dts;
-    uint32_t audio_dts;
+    int64_t video_dts;
+    // audio timestamps are derived from the number of samples
+    int64_t audio_samples;
     uint32_t gop_beginning_video_pts;
+
+    // whole GOP read ahead, frames are read from it before the input
+    uint8_t *gop_buf;
+    unsigned int gop_buf_size;
+    int64_t gop_buf_start;
+    int gop_buf_pos;
+    int gop_buf_end;
+
+    // GOP index, built on the first seek
+    Hvqm4GopEntry *gops;
+    uint32_t nb_indexed_gops;
+    int index_built;
 } Hvqm4DemuxContext;
 
 static int hvqm4_read_header(AVFormatContext *ctx)
 {
-    av_log(ctx, AV_LOG_TRACE, "hvqm4_read_header\n");
     Hvqm4DemuxContext *h4m = ctx->priv_data;
-    memset(h4m, 0, sizeof(*h4m));
     AVIOContext *pb = ctx->pb;
+    uint32_t video_frames, audio_frames, frame_usec;
+    uint32_t audio_frame_size, audio_sample_rate;
+    uint16_t width, height;
+    uint8_t hsamp, vsamp, audio_channels, audio_bitdepth;
+    int has_video, has_audio;
 
     avio_skip(pb, HVQM4_MAGIC_SIZE);
-    uint32_t header_size = avio_rb32(pb);
-    if (header_size != 0x44)
+    if (avio_rb32(pb) != HVQM4_FILE_HEADER_SIZE)
         return AVERROR_INVALIDDATA;
-    uint32_t body_size = avio_rb32(pb);
+    avio_skip(pb, 4); // body size
     h4m->file.nb_gops = avio_rb32(pb);
-    uint32_t video_frames = avio_rb32(pb);
-    uint32_t audio_frames = avio_rb32(pb);
-    uint32_t frame_usec = avio_rb32(pb);
-    uint32_t max_frame_size = avio_rb32(pb);
+    video_frames      = avio_rb32(pb);
+    audio_frames      = avio_rb32(pb);
+    frame_usec        = avio_rb32(pb);
+    avio_skip(pb, 4); // largest frame size
     avio_skip(pb, 4); // unknown
-    uint32_t audio_frame_size = avio_rb32(pb);
-    uint16_t width = avio_rb16(pb);
-    uint16_t height = avio_rb16(pb);
-    uint8_t hsamp = avio_r8(pb);
-    uint8_t vsamp = avio_r8(pb);
-    uint8_t video_mode = avio_r8(pb);
+    audio_frame_size  = avio_rb32(pb);
+    width             = avio_rb16(pb);
+    height            = avio_rb16(pb);
+    hsamp             = avio_r8(pb);
+    vsamp             = avio_r8(pb);
+    avio_skip(pb, 1); // video mode
     avio_skip(pb, 1); // unknown
-    uint8_t audio_channels = avio_r8(pb);
-    uint8_t audio_bitdepth = avio_r8(pb);
+    audio_channels    = avio_r8(pb);
+    audio_bitdepth    = avio_r8(pb);
     avio_skip(pb, 2); // unknown
-    uint32_t audio_sample_rate = avio_rb32(pb);
+    audio_sample_rate = avio_rb32(pb);
+    if (avio_feof(pb))
+        return AVERROR_INVALIDDATA;
+
+    h4m->video_stream_index = -1;
+    h4m->audio_stream_index = -1;
+
+    // the totals are left at zero when the file was written to a
+    // non-seekable output, its GOPs are then read up to the end
+    has_video = video_frames ||
+                (!h4m->file.nb_gops && width && height);
+    has_audio = audio_frames ||
+                (!h4m->file.nb_gops && audio_channels && audio_sample_rate);
+
+    if (has_video) {
+        AVStream *vid;
 
-    if (video_frames) {
-        AVStream *vid = avformat_new_stream(ctx, NULL);
+        if (!frame_usec)
+            return AVERROR_INVALIDDATA;
+        vid = avformat_new_stream(ctx, NULL);
         if (!vid)
             return AVERROR(ENOMEM);
         avpriv_set_pts_info(vid, 64, frame_usec, 1000000);
@@ -116,139 +163,675 @@ static int hvqm4_read_header(AVFormatContext *ctx)
         vid->codecpar->extradata[1] = vsamp;
         vid->codecpar->width = width;
         vid->codecpar->height = height;
-        vid->nb_frames = video_frames;
-        vid->duration = video_frames;
+        // B frames are reordered by one anchor
+        vid->codecpar->video_delay = 1;
+        if (video_frames) {
+            vid->nb_frames = video_frames;
+            vid->duration = video_frames;
+        }
         h4m->video_stream_index = vid->index;
     }
 
-    if (audio_frames) {
+    if (has_audio) {
         AVStream *aud = avformat_new_stream(ctx, NULL);
         if (!aud)
             return AVERROR(ENOMEM);
         // pts is in microseconds
         avpriv_set_pts_info(aud, 64, 1, 1000000);
         aud->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
-        aud->codecpar->codec_id = AV_CODEC_ID_NONE;
+        if (audio_bitdepth == 4)
+            aud->codecpar->codec_id = AV_CODEC_ID_ADPCM_IMA_HVQM4;
+        else
+            avpriv_request_sample(ctx, "%u bit audio", audio_bitdepth);
         aud->codecpar->channels = audio_channels;
         aud->codecpar->sample_rate = audio_sample_rate;
+        aud->codecpar->bits_per_coded_sample = audio_bitdepth;
+        // largest audio frame in the file
+        aud->codecpar->block_align = audio_frame_size;
         h4m->audio_stream_index = aud->index;
     }
 
-    h4m->gop_beginning_video_pts = 1; // one frame headroom
+    h4m->frame_usec = frame_usec;
+    h4m->audio_sample_rate = audio_sample_rate;
+    // the first anchor is displayed after the B frames that follow it
+    h4m->video_dts = -1;
 
     return 0;
 }
 
-static int hvqm4_read_packet(AVFormatContext *ctx, AVPacket *pkt)
+static int64_t hvqm4_tell(AVFormatContext *ctx)
+{
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+
+    if (h4m->gop_buf_pos < h4m->gop_buf_end)
+        return h4m->gop_buf_start + h4m->gop_buf_pos;
+    return avio_tell(ctx->pb);
+}
+
+// read from what is left of the buffered GOP first, then from the input
+static int hvqm4_read_data(AVFormatContext *ctx, uint8_t *buf, int size)
 {
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+    int buffered = FFMIN(size, h4m->gop_buf_end - h4m->gop_buf_pos);
     int ret;
+
+    if (buffered) {
+        memcpy(buf, h4m->gop_buf + h4m->gop_buf_pos, buffered);
+        h4m->gop_buf_pos += buffered;
+        if (buffered == size)
+            return size;
+    }
+
+    ret = avio_read(ctx->pb, buf + buffered, size - buffered);
+    if (ret < 0)
+        return buffered ? buffered : ret;
+    return buffered + ret;
+}
+
+// read the rest of the current GOP with a single request, the frames are
+// then parsed from the buffer
+static int hvqm4_read_gop(AVFormatContext *ctx)
+{
     Hvqm4DemuxContext *h4m = ctx->priv_data;
     AVIOContext *pb = ctx->pb;
+    int size, ret;
+
+    // bytes left over from the previous GOP have to be consumed first
+    if (h4m->gop_buf_pos < h4m->gop_buf_end)
+        return 0;
+    h4m->gop_buf_pos = h4m->gop_buf_end = 0;
+
+    // fall back to reading frame by frame
+    if (h4m->gop.next_size <= HVQM4_GOP_HEADER_SIZE ||
+        h4m->gop.next_size - HVQM4_GOP_HEADER_SIZE > INT_MAX)
+        return 0;
+
+    size = ffio_limit(pb, h4m->gop.next_size - HVQM4_GOP_HEADER_SIZE);
+    av_fast_malloc(&h4m->gop_buf, &h4m->gop_buf_size, size);
+    if (!h4m->gop_buf)
+        return AVERROR(ENOMEM);
+
+    h4m->gop_buf_start = avio_tell(pb);
+    ret = avio_read(pb, h4m->gop_buf, size);
+    if (ret < 0)
+        return ret;
+    h4m->gop_buf_end = ret;
+
+    return 0;
+}
+
+static int hvqm4_read_frame(AVFormatContext *ctx, AVPacket *pkt, uint16_t *media_type)
+{
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+    int64_t pos = hvqm4_tell(ctx);
+    uint8_t header[8];
+    uint16_t frame_type;
+    uint32_t frame_size;
+    int buffered, ret;
+
+    ret = hvqm4_read_data(ctx, header, sizeof(header));
+    if (ret < (int)sizeof(header)) {
+        if (ret < 0)
+            return ret;
+        if (!ret)
+            return AVERROR_EOF;
+        av_log(ctx, AV_LOG_ERROR, "truncated frame header\n");
+        return AVERROR_INVALIDDATA;
+    }
+    *media_type = AV_RB16(header);
+    // frame type (I/P/B)
+    frame_type  = AV_RB16(header + 2);
+    frame_size  = AV_RB32(header + 4);
+    if (frame_size < 4 || frame_size > INT_MAX - 2 - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR_INVALIDDATA;
+    // do not allocate a frame running past the end of the input
+    buffered = h4m->gop_buf_end - h4m->gop_buf_pos;
+    if (frame_size > buffered &&
+        ffio_limit(ctx->pb, frame_size - buffered) < frame_size - buffered)
+        goto truncated;
+
+    // forward frame type followed by the payload
+    if ((ret = av_new_packet(pkt, 2 + frame_size)) < 0)
+        return ret;
+    AV_WB16(pkt->data, frame_type);
+    ret = hvqm4_read_data(ctx, pkt->data + 2, frame_size);
+    if (ret < 0 || ret < frame_size) {
+        av_packet_unref(pkt);
+        if (ret < 0)
+            return ret;
+        goto truncated;
+    }
+    pkt->pos = pos;
+
+    return 0;
+
+truncated:
+    av_log(ctx, AV_LOG_ERROR, "frame of %u bytes at %"PRId64" truncated\n",
+           frame_size, pos);
+    return AVERROR_INVALIDDATA;
+}
+
+// GOP structure as packet metadata, so it can be inspected without decoding
+static int hvqm4_export_frame_info(AVFormatContext *ctx, AVPacket *pkt,
+                                   uint16_t media_type, uint32_t disp_id)
+{
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+    AVDictionary *dict = NULL;
+    uint8_t *side_data, *packed;
+    int size, ret = 0;
+
+    av_dict_set_int(&dict, "gop_index", h4m->gop_index - 1, 0);
+    if (media_type == 1) {
+        const char *frame_type;
+        switch (AV_RB16(pkt->data)) {
+        case 0x10: frame_type = "I"; break;
+        case 0x20: frame_type = "P"; break;
+        case 0x30: frame_type = "B"; break;
+        default:   frame_type = "?"; break;
+        }
+        av_dict_set(&dict, "frame_type", frame_type, 0);
+        av_dict_set_int(&dict, "disp_id", disp_id, 0);
+    }
+
+    packed = av_packet_pack_dictionary(dict, &size);
+    av_dict_free(&dict);
+    if (!packed)
+        return AVERROR(ENOMEM);
+    side_data = av_packet_new_side_data(pkt, AV_PKT_DATA_STRINGS_METADATA, size);
+    if (side_data)
+        memcpy(side_data, packed, size);
+    else
+        ret = AVERROR(ENOMEM);
+    av_free(packed);
+
+    return ret;
+}
+
+static int hvqm4_read_packet(AVFormatContext *ctx, AVPacket *pkt)
+{
+    int ret;
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+    uint8_t gop_header[HVQM4_GOP_HEADER_SIZE];
+    uint16_t media_type;
+    uint32_t disp_id;
     //av_log(ctx, AV_LOG_TRACE, "hvqm4_read_packet at %ld\n", avio_tell(pb));
 
-    // are we expecting a new GOP?
-    if (h4m->gop_video_index == h4m->gop.nb_video_frames &&
-        h4m->gop_audio_index == h4m->gop.nb_audio_frames) {
+    for (;;) {
+        // are we expecting a new GOP?
+        if (h4m->gop_video_index >= h4m->gop.nb_video_frames &&
+            h4m->gop_audio_index >= h4m->gop.nb_audio_frames) {
 
-        if (h4m->gop_index < h4m->file.nb_gops) {
+            if (h4m->file.nb_gops && h4m->gop_index >= h4m->file.nb_gops) {
+                av_log(ctx, AV_LOG_TRACE, "hvqm4 says EOF\n");
+                return AVERROR_EOF;
+            }
             ++h4m->gop_index;
             av_log(ctx, AV_LOG_DEBUG, "GOP %u/%u\n", h4m->gop_index, h4m->file.nb_gops);
 
             h4m->gop_beginning_video_pts += h4m->gop.nb_video_frames;
 
             // read GOP header
-            h4m->gop_start = avio_tell(pb);
-            h4m->gop.prev_size = avio_rb32(pb);
-            h4m->gop.next_size = avio_rb32(pb);
-            h4m->gop.nb_video_frames = avio_rb32(pb);
-            h4m->gop.nb_audio_frames = avio_rb32(pb);
-            uint32_t unknown = avio_rb32(pb);
-            if (unknown != 0x01000000)
+            h4m->gop_start = hvqm4_tell(ctx);
+            ret = hvqm4_read_data(ctx, gop_header, HVQM4_GOP_HEADER_SIZE);
+            if (ret < HVQM4_GOP_HEADER_SIZE)
+                return ret < 0 ? ret : AVERROR_EOF;
+            h4m->gop.prev_size = AV_RB32(gop_header);
+            h4m->gop.next_size = AV_RB32(gop_header + 4);
+            h4m->gop.nb_video_frames = AV_RB32(gop_header + 8);
+            h4m->gop.nb_audio_frames = AV_RB32(gop_header + 12);
+            if (AV_RB32(gop_header + 16) != 0x01000000)
                 av_log(ctx, AV_LOG_WARNING, "unexpected value in GOP header\n");
 
             h4m->gop_video_index = 0;
             h4m->gop_audio_index = 0;
-        } else {
-            av_log(ctx, AV_LOG_TRACE, "hvqm4 says EOF\n");
-            return AVERROR_EOF;
-        }
-    }
 
-    if (h4m->gop_video_index < h4m->gop.nb_video_frames ||
-        h4m->gop_audio_index < h4m->gop.nb_audio_frames) {
+            if (h4m->gop_readahead && (ret = hvqm4_read_gop(ctx)) < 0)
+                return ret;
+            // empty GOPs are skipped
+            continue;
+        }
 
-        // read frame
-        uint16_t media_type = avio_rb16(pb);
-        // read frame type (I/P/B)
-        uint16_t frame_type = avio_rb16(pb);
-        avio_seek(pb, -2, SEEK_CUR);
-        // forward frame type
-        if ((ret = av_get_packet(pb, pkt, 2)) < 0)
+        if ((ret = hvqm4_read_frame(ctx, pkt, &media_type)) < 0)
             return ret;
-        if (ret < 2) {
-            av_packet_unref(pkt);
-            return AVERROR(EIO);
-        }
-        uint32_t frame_size = avio_rb32(pb);
-        // read display order
-        uint16_t disp_id = avio_rb32(pb);
-        avio_seek(pb, -4, SEEK_CUR);
-        // payload
-        ret = av_append_packet(pb, pkt, frame_size);
-        // FIXME: signed vs unsigned
-        if (ret < frame_size) {
-            av_packet_unref(pkt);
-            return AVERROR(EIO);
-        }
+
+        // display order for video, number of samples for audio
+        disp_id = AV_RB32(pkt->data + 2);
 
         if (media_type == 0) {
-            pkt->dts = h4m->audio_dts++;
+            uint32_t nb_samples = disp_id;
+            if (h4m->audio_sample_rate) {
+                pkt->pts = av_rescale(h4m->audio_samples, 1000000, h4m->audio_sample_rate);
+                pkt->duration = av_rescale(h4m->audio_samples + nb_samples, 1000000,
+                                           h4m->audio_sample_rate) - pkt->pts;
+            }
+            pkt->dts = pkt->pts;
+            h4m->audio_samples += nb_samples;
             ++h4m->gop_audio_index;
             //av_log(ctx, AV_LOG_DEBUG, "audio packet %u/%u\n", h4m->gop_audio_index, h4m->gop.nb_audio_frames);
             pkt->stream_index = h4m->audio_stream_index;
         } else if (media_type == 1) {
+            // global display order
+            pkt->pts = h4m->gop_beginning_video_pts + disp_id;
             pkt->dts = h4m->video_dts++;
+            pkt->duration = 1;
+            if (AV_RB16(pkt->data) == 0x10)
+                pkt->flags |= AV_PKT_FLAG_KEY;
             ++h4m->gop_video_index;
             //av_log(ctx, AV_LOG_DEBUG, "video packet %u/%u\n", h4m->gop_video_index, h4m->gop.nb_video_frames);
             pkt->stream_index = h4m->video_stream_index;
         } else {
             av_log(ctx, AV_LOG_ERROR, "unknown media type\n");
+            av_packet_unref(pkt);
             return AVERROR_INVALIDDATA;
         }
-        pkt->pts = h4m->gop_beginning_video_pts + disp_id;
+
+        // the file header announced no frames of this type
+        if (pkt->stream_index < 0) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        if (h4m->export_frame_info &&
+            (ret = hvqm4_export_frame_info(ctx, pkt, media_type, disp_id)) < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+        return 0;
     }
+}
+
+// walk the prev_size/next_size chain and record where each GOP starts
+static int hvqm4_build_index(AVFormatContext *ctx)
+{
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+    AVIOContext *pb = ctx->pb;
+    AVStream *vid = ctx->streams[h4m->video_stream_index];
+    int64_t file_size = avio_size(pb);
+    int64_t pos = HVQM4_FILE_HEADER_SIZE;
+    uint32_t video_frames = 0;
+    Hvqm4GopEntry *gops = NULL;
+    unsigned int gops_size = 0;
+    uint32_t nb_gops = 0;
+
+    // the GOP count of the file header is not trusted, the index only
+    // grows with the GOPs actually found; without a count the chain is
+    // walked up to the end of the file
+    while (!h4m->file.nb_gops || nb_gops < h4m->file.nb_gops) {
+        Hvqm4GopEntry *tmp;
+        uint32_t next_size, nb_video_frames;
+
+        if (file_size > 0 && pos + HVQM4_GOP_HEADER_SIZE > file_size)
+            break;
+        if (avio_seek(pb, pos, SEEK_SET) < 0)
+            break;
+        avio_skip(pb, 4); // prev_size
+        next_size       = avio_rb32(pb);
+        nb_video_frames = avio_rb32(pb);
+        if (avio_feof(pb))
+            break;
+
+        if (nb_gops >= INT_MAX / sizeof(*gops))
+            break;
+        tmp = av_fast_realloc(gops, &gops_size, (nb_gops + 1) * sizeof(*gops));
+        if (!tmp) {
+            av_free(gops);
+            return AVERROR(ENOMEM);
+        }
+        gops = tmp;
+        gops[nb_gops].pos = pos;
+        gops[nb_gops].video_frames_before = video_frames;
+        nb_gops++;
+
+        // every GOP starts with an I frame
+        if (nb_video_frames)
+            av_add_index_entry(vid, pos, video_frames, next_size, 0, AVINDEX_KEYFRAME);
+
+        video_frames += nb_video_frames;
+
+        if (next_size < HVQM4_GOP_HEADER_SIZE)
+            break;
+        pos += next_size;
+    }
+
+    if (nb_gops < h4m->file.nb_gops)
+        av_log(ctx, AV_LOG_WARNING, "GOP chain broken, indexed %u/%u GOPs\n",
+               nb_gops, h4m->file.nb_gops);
+
+    h4m->gops = gops;
+    h4m->nb_indexed_gops = nb_gops;
+    h4m->index_built = 1;
+
     return 0;
 }
 
 static int hvqm4_read_seek(AVFormatContext *ctx, int stream_index, int64_t timestamp, int flags)
 {
-    av_log(ctx, AV_LOG_DEBUG, "hvqm4_read_seek %ld %d\n", timestamp, flags);
     Hvqm4DemuxContext *h4m = ctx->priv_data;
-    AVStream *st = ctx->streams[stream_index];
     AVIOContext *pb = ctx->pb;
+    const Hvqm4GopEntry *gop;
+    AVStream *vid;
+    uint32_t lo, hi;
+    int64_t pos;
+    int index, ret;
+
+    av_log(ctx, AV_LOG_DEBUG, "hvqm4_read_seek %"PRId64" %d\n", timestamp, flags);
 
     if (!(pb->seekable & AVIO_SEEKABLE_NORMAL))
         return -1;
+    if (h4m->video_stream_index < 0)
+        return -1;
+
+    if (!h4m->index_built) {
+        pos = avio_tell(pb);
+        if ((ret = hvqm4_build_index(ctx)) < 0)
+            return ret;
+        if (avio_seek(pb, pos, SEEK_SET) < 0)
+            return -1;
+    }
+
+    // all streams are seeked by video GOP
+    vid = ctx->streams[h4m->video_stream_index];
+    if (stream_index != h4m->video_stream_index)
+        timestamp = av_rescale_q(timestamp, ctx->streams[stream_index]->time_base, vid->time_base);
+
+    index = av_index_search_timestamp(vid, timestamp, flags);
+    if (index < 0)
+        return -1;
+    pos = vid->index_entries[index].pos;
 
-    if (avio_seek(pb, h4m->gop_start, SEEK_SET) < 0)
+    lo = 0;
+    hi = h4m->nb_indexed_gops;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (h4m->gops[mid].pos <= pos)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    gop = &h4m->gops[lo];
+
+    if (avio_seek(pb, gop->pos, SEEK_SET) < 0)
         return -1;
 
-    h4m->gop_index -= 1;
+    // make hvqm4_read_packet() read this GOP's header next
+    h4m->gop_buf_pos = h4m->gop_buf_end = 0;
+    h4m->gop_index = lo;
     h4m->gop_video_index = 0;
     h4m->gop_audio_index = 0;
     h4m->gop.nb_video_frames = 0;
     h4m->gop.nb_audio_frames = 0;
+    h4m->video_dts = (int64_t)gop->video_frames_before - 1;
+    h4m->gop_beginning_video_pts = gop->video_frames_before;
+    // audio and video are interleaved in sync, so audio continues at the
+    // time of the GOP's first video frame
+    h4m->audio_samples = av_rescale((int64_t)gop->video_frames_before * h4m->frame_usec,
+                                    h4m->audio_sample_rate, 1000000);
+
+    return 0;
+}
 
+static int hvqm4_read_close(AVFormatContext *ctx)
+{
+    Hvqm4DemuxContext *h4m = ctx->priv_data;
+    av_freep(&h4m->gop_buf);
+    av_freep(&h4m->gops);
     return 0;
 }
 
+#define OFFSET(x) offsetof(Hvqm4DemuxContext, x)
+static const AVOption hvqm4_options[] = {
+    { "gop_readahead", "read each GOP with a single request", OFFSET(gop_readahead), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "export_frame_info", "export GOP index, frame type and display order as packet metadata", OFFSET(export_frame_info), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass hvqm4_demuxer_class = {
+    .class_name = "hvqm4 demuxer",
+    .item_name  = av_default_item_name,
+    .option     = hvqm4_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVInputFormat ff_hvqm4_demuxer = {
     .name           = "hvqm4",
     .long_name      = NULL_IF_CONFIG_SMALL("Hudson HVQM4"),
     .extensions     = "h4m",
     .priv_data_size = sizeof(Hvqm4DemuxContext),
+    .priv_class     = &hvqm4_demuxer_class,
     .read_probe     = hvqm4_read_probe,
     .read_header    = hvqm4_read_header,
     .read_packet    = hvqm4_read_packet,
     .read_seek      = hvqm4_read_seek,
+    .read_close     = hvqm4_read_close,
+    // the generic search would read frames without the state of their GOP
+    .flags          = AVFMT_NOGENSEARCH,
+};
+#endif /* CONFIG_HVQM4_DEMUXER */
+
+#if CONFIG_HVQM4_MUXER
+typedef struct
+{
+    AVIOContext *gop;
+    uint32_t gop_video_frames;
+    uint32_t gop_audio_frames;
+    uint32_t prev_gop_size;
+
+    int video_stream_index;
+    int audio_stream_index;
+    uint32_t frame_usec;
+
+    // file header fields that are only known at the end
+    uint32_t body_size;
+    uint32_t nb_gops;
+    uint32_t video_frames;
+    uint32_t audio_frames;
+    uint32_t max_video_frame_size;
+    uint32_t max_audio_frame_size;
+} Hvqm4MuxContext;
+
+static void hvqm4_write_file_header(AVFormatContext *ctx)
+{
+    static const uint8_t magic[HVQM4_MAGIC_SIZE] = "HVQM4 1.3";
+    Hvqm4MuxContext *h4m = ctx->priv_data;
+    AVIOContext *pb = ctx->pb;
+    AVCodecParameters *vpar = h4m->video_stream_index >= 0 ?
+                              ctx->streams[h4m->video_stream_index]->codecpar : NULL;
+    AVCodecParameters *apar = h4m->audio_stream_index >= 0 ?
+                              ctx->streams[h4m->audio_stream_index]->codecpar : NULL;
+    int hsamp = 2, vsamp = 2;
+
+    if (vpar && vpar->extradata_size >= 2) {
+        hsamp = vpar->extradata[0];
+        vsamp = vpar->extradata[1];
+    }
+
+    avio_write(pb, magic, HVQM4_MAGIC_SIZE);
+    avio_wb32(pb, HVQM4_FILE_HEADER_SIZE);
+    avio_wb32(pb, h4m->body_size);
+    avio_wb32(pb, h4m->nb_gops);
+    avio_wb32(pb, h4m->video_frames);
+    avio_wb32(pb, h4m->audio_frames);
+    avio_wb32(pb, h4m->frame_usec);
+    avio_wb32(pb, h4m->max_video_frame_size);
+    avio_wb32(pb, 0); // unknown
+    avio_wb32(pb, h4m->max_audio_frame_size);
+    avio_wb16(pb, vpar ? vpar->width  : 0);
+    avio_wb16(pb, vpar ? vpar->height : 0);
+    avio_w8(pb, hsamp);
+    avio_w8(pb, vsamp);
+    avio_w8(pb, 0); // video mode
+    avio_w8(pb, 0); // unknown
+    avio_w8(pb, apar ? apar->channels : 0);
+    avio_w8(pb, apar ? apar->bits_per_coded_sample : 0);
+    avio_wb16(pb, 0); // unknown
+    avio_wb32(pb, apar ? apar->sample_rate : 0);
+}
+
+static int hvqm4_write_header(AVFormatContext *ctx)
+{
+    Hvqm4MuxContext *h4m = ctx->priv_data;
+    int i;
+
+    h4m->video_stream_index = -1;
+    h4m->audio_stream_index = -1;
+
+    for (i = 0; i < ctx->nb_streams; i++) {
+        AVStream *st = ctx->streams[i];
+        AVCodecParameters *par = st->codecpar;
+
+        if (par->codec_id == AV_CODEC_ID_HVQM4 && h4m->video_stream_index < 0) {
+            AVRational frame_duration = st->avg_frame_rate.num && st->avg_frame_rate.den ?
+                                        av_inv_q(st->avg_frame_rate) : st->time_base;
+            if (par->width > UINT16_MAX || par->height > UINT16_MAX) {
+                av_log(ctx, AV_LOG_ERROR, "dimensions %dx%d too large\n",
+                       par->width, par->height);
+                return AVERROR(EINVAL);
+            }
+            h4m->frame_usec = av_rescale_q(1, frame_duration, AV_TIME_BASE_Q);
+            if (!h4m->frame_usec) {
+                av_log(ctx, AV_LOG_ERROR, "invalid frame rate\n");
+                return AVERROR(EINVAL);
+            }
+            // the demuxer reads packets back with this time base
+            avpriv_set_pts_info(st, 64, h4m->frame_usec, 1000000);
+            h4m->video_stream_index = i;
+        } else if (par->codec_id == AV_CODEC_ID_ADPCM_IMA_HVQM4 && h4m->audio_stream_index < 0) {
+            avpriv_set_pts_info(st, 64, 1, 1000000);
+            h4m->audio_stream_index = i;
+        } else {
+            av_log(ctx, AV_LOG_ERROR,
+                   "only one hvqm4 video and one adpcm_ima_hvqm4 audio stream are supported\n");
+            return AVERROR(EINVAL);
+        }
+    }
+
+    hvqm4_write_file_header(ctx);
+
+    return 0;
+}
+
+// a GOP is buffered until it is complete so that its header can be
+// written up front, even on non-seekable outputs
+static int hvqm4_flush_gop(AVFormatContext *ctx)
+{
+    Hvqm4MuxContext *h4m = ctx->priv_data;
+    AVIOContext *pb = ctx->pb;
+    uint32_t gop_size;
+    uint8_t *buf;
+    int size;
+
+    if (!h4m->gop)
+        return 0;
+
+    size = avio_close_dyn_buf(h4m->gop, &buf);
+    h4m->gop = NULL;
+    if (size > UINT32_MAX - HVQM4_GOP_HEADER_SIZE - h4m->body_size) {
+        av_free(buf);
+        av_log(ctx, AV_LOG_ERROR, "file too large\n");
+        return AVERROR(EINVAL);
+    }
+
+    gop_size = HVQM4_GOP_HEADER_SIZE + size;
+    avio_wb32(pb, h4m->prev_gop_size);
+    avio_wb32(pb, gop_size);
+    avio_wb32(pb, h4m->gop_video_frames);
+    avio_wb32(pb, h4m->gop_audio_frames);
+    avio_wb32(pb, 0x01000000); // unknown
+    avio_write(pb, buf, size);
+    av_free(buf);
+
+    h4m->prev_gop_size = gop_size;
+    h4m->body_size += gop_size;
+    h4m->nb_gops++;
+    h4m->video_frames += h4m->gop_video_frames;
+    h4m->audio_frames += h4m->gop_audio_frames;
+    h4m->gop_video_frames = 0;
+    h4m->gop_audio_frames = 0;
+
+    return 0;
+}
+
+static int hvqm4_write_packet(AVFormatContext *ctx, AVPacket *pkt)
+{
+    Hvqm4MuxContext *h4m = ctx->priv_data;
+    int is_video = pkt->stream_index == h4m->video_stream_index;
+    uint16_t frame_type;
+    uint32_t frame_size;
+    int ret;
+
+    // packets carry the frame type followed by the frame payload,
+    // which starts with the display order or the number of samples
+    if (pkt->size < 6) {
+        av_log(ctx, AV_LOG_ERROR, "packet too small\n");
+        return AVERROR(EINVAL);
+    }
+    frame_type = AV_RB16(pkt->data);
+    frame_size = pkt->size - 2;
+
+    av_assert0(is_video || pkt->stream_index == h4m->audio_stream_index);
+
+    // every I frame starts a new GOP
+    if (is_video && frame_type == 0x10 && h4m->gop_video_frames) {
+        if ((ret = hvqm4_flush_gop(ctx)) < 0)
+            return ret;
+    }
+
+    if (!h4m->gop && (ret = avio_open_dyn_buf(&h4m->gop)) < 0)
+        return ret;
+
+    avio_wb16(h4m->gop, !!is_video);
+    avio_wb16(h4m->gop, frame_type);
+    avio_wb32(h4m->gop, frame_size);
+    avio_write(h4m->gop, pkt->data + 2, frame_size);
+
+    if (is_video) {
+        h4m->gop_video_frames++;
+        h4m->max_video_frame_size = FFMAX(h4m->max_video_frame_size, frame_size);
+    } else {
+        h4m->gop_audio_frames++;
+        h4m->max_audio_frame_size = FFMAX(h4m->max_audio_frame_size, frame_size);
+    }
+
+    return 0;
+}
+
+static int hvqm4_write_trailer(AVFormatContext *ctx)
+{
+    AVIOContext *pb = ctx->pb;
+    int ret;
+
+    if ((ret = hvqm4_flush_gop(ctx)) < 0)
+        return ret;
+
+    if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
+        int64_t end = avio_tell(pb);
+        avio_seek(pb, 0, SEEK_SET);
+        hvqm4_write_file_header(ctx);
+        avio_seek(pb, end, SEEK_SET);
+    } else {
+        av_log(ctx, AV_LOG_VERBOSE, "output is not seekable, file header totals left at zero\n");
+    }
+
+    return 0;
+}
+
+static void hvqm4_deinit(AVFormatContext *ctx)
+{
+    Hvqm4MuxContext *h4m = ctx->priv_data;
+    ffio_free_dyn_buf(&h4m->gop);
+}
+
+AVOutputFormat ff_hvqm4_muxer = {
+    .name           = "hvqm4",
+    .long_name      = NULL_IF_CONFIG_SMALL("Hudson HVQM4"),
+    .extensions     = "h4m",
+    .priv_data_size = sizeof(Hvqm4MuxContext),
+    .audio_codec    = AV_CODEC_ID_ADPCM_IMA_HVQM4,
+    .video_codec    = AV_CODEC_ID_HVQM4,
+    .write_header   = hvqm4_write_header,
+    .write_packet   = hvqm4_write_packet,
+    .write_trailer  = hvqm4_write_trailer,
+    .deinit         = hvqm4_deinit,
+    .flags          = AVFMT_NOTIMESTAMPS,
 };
+#endif /* CONFIG_HVQM4_MUXER */
@@ -0,0 +1,124 @@
+/*
+ * raw HVQM4 frame record demuxer
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Demuxer for streams of HVQM4 frame records (media type, frame type,
+ * payload size, payload) without the .h4m file and GOP headers. The
+ * hvqm4 parser splits them into video frames.
+ */
+
+#include "libavutil/intreadwrite.h"
+#include "libavutil/opt.h"
+#include "avformat.h"
+#include "internal.h"
+#include "rawdec.h"
+
+#define HVQM4_RECORD_HEADER_SIZE 8
+
+typedef struct HVQM4RawDemuxerContext {
+    FFRawVideoDemuxerContext raw;   ///< must be first, used by the raw demuxer helpers
+    int width, height;
+    int h_samp, v_samp;
+} HVQM4RawDemuxerContext;
+
+static int hvqm4raw_probe(const AVProbeData *p)
+{
+    const uint8_t *ptr = p->buf, *end = p->buf + p->buf_size;
+    int nb_records = 0, nb_video = 0;
+
+    while (end - ptr >= HVQM4_RECORD_HEADER_SIZE) {
+        int media_type = AV_RB16(ptr);
+        int frame_type = AV_RB16(ptr + 2);
+        uint32_t size  = AV_RB32(ptr + 4);
+
+        if (media_type > 1 || size < 4 || size > 0x1000000)
+            return 0;
+        if (media_type == 1) {
+            if (frame_type != 0x10 && frame_type != 0x20 && frame_type != 0x30)
+                return 0;
+            // a stream starts with an I frame
+            if (!nb_video++ && frame_type != 0x10)
+                return 0;
+        } else if (frame_type >= 0x10) {
+            return 0;
+        }
+        nb_records++;
+        if (size > end - ptr - HVQM4_RECORD_HEADER_SIZE)
+            break;
+        ptr += HVQM4_RECORD_HEADER_SIZE + size;
+    }
+
+    if (nb_records >= 4 && nb_video)
+        return AVPROBE_SCORE_EXTENSION / 2;
+    return 0;
+}
+
+static int hvqm4raw_read_header(AVFormatContext *s)
+{
+    HVQM4RawDemuxerContext *h = s->priv_data;
+    AVStream *st;
+    int ret;
+
+    if ((ret = ff_raw_video_read_header(s)) < 0)
+        return ret;
+
+    // the records carry neither the dimensions nor the chroma sampling
+    st = s->streams[0];
+    st->codecpar->width       = h->width;
+    st->codecpar->height      = h->height;
+    st->codecpar->video_delay = 1;
+    if (ff_alloc_extradata(st->codecpar, 2))
+        return AVERROR(ENOMEM);
+    st->codecpar->extradata[0] = h->h_samp;
+    st->codecpar->extradata[1] = h->v_samp;
+
+    return 0;
+}
+
+#define OFFSET(x) offsetof(HVQM4RawDemuxerContext, x)
+#define DEC AV_OPT_FLAG_DECODING_PARAM
+static const AVOption hvqm4raw_options[] = {
+    { "framerate", "", OFFSET(raw.framerate), AV_OPT_TYPE_VIDEO_RATE, {.str = "30000/1001"}, 0, INT_MAX, DEC },
+    { "raw_packet_size", "", OFFSET(raw.raw_packet_size), AV_OPT_TYPE_INT, {.i64 = 1024}, 1, INT_MAX, DEC },
+    { "video_size", "set frame size", OFFSET(width), AV_OPT_TYPE_IMAGE_SIZE, {.str = NULL}, 0, 0, DEC },
+    { "h_samp", "set horizontal chroma subsampling", OFFSET(h_samp), AV_OPT_TYPE_INT, {.i64 = 2}, 1, 2, DEC },
+    { "v_samp", "set vertical chroma subsampling", OFFSET(v_samp), AV_OPT_TYPE_INT, {.i64 = 2}, 1, 2, DEC },
+    { NULL },
+};
+
+static const AVClass hvqm4raw_demuxer_class = {
+    .class_name = "hvqm4raw demuxer",
+    .item_name  = av_default_item_name,
+    .option     = hvqm4raw_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+AVInputFormat ff_hvqm4raw_demuxer = {
+    .name           = "hvqm4raw",
+    .long_name      = NULL_IF_CONFIG_SMALL("raw HVQM4 frame records"),
+    .priv_data_size = sizeof(HVQM4RawDemuxerContext),
+    .read_probe     = hvqm4raw_probe,
+    .read_header    = hvqm4raw_read_header,
+    .read_packet    = ff_raw_read_partial_packet,
+    .flags          = AVFMT_GENERIC_INDEX,
+    .raw_codec_id   = AV_CODEC_ID_HVQM4,
+    .priv_class     = &hvqm4raw_demuxer_class,
+};
@@ -243,6 +243,28 @@ stream_remux(){
         -f framecrc - || return
 }
 
+# the -benchmark_stages report without the timings and the directories
+benchmark_stages(){
+    reportfile="${outdir}/${test}.json"
+    cleanfiles="$cleanfiles $reportfile"
+    ffmpeg "$@" -benchmark_stages_file $(target_path $reportfile) -f null - || return
+    sed -e 's/_usec":[0-9]*/_usec":0/g' -e 's#"url":"[^"]*/#"url":"#g' $reportfile
+}
+
+# remux to a non-seekable output, then demux the result again
+pipe_remux(){
+    src_fmt=$1
+    srcfile=$2
+    enc_fmt=$3
+    encfile="${outdir}/${test}.${enc_fmt}"
+    test "$4" = -keep || cleanfiles="$cleanfiles $encfile"
+    tsrcfile=$(target_path $srcfile)
+    ffmpeg -f $src_fmt -i $tsrcfile -codec copy $FLAGS \
+        -f $enc_fmt pipe: > $encfile || return
+    ffmpeg $DEC_OPTS -i $(target_path $encfile) -codec copy $FLAGS \
+        -f framecrc - || return
+}
+
 # FIXME: There is a certain duplication between the avconv-related helper
 # functions above and below that should be refactored.
 ffmpeg2="$target_exec ${target_path}/ffmpeg${PROGSUF}${EXECSUF}"
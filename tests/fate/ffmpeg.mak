@@ -41,6 +41,41 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -idct simple -fflags +bitexact -flag
 FATE_FFMPEG-$(CONFIG_COLOR_FILTER) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+FATE_FFMPEG-$(call ALLYES, TESTSRC_FILTER SPLIT_FILTER SINE_FILTER) += fate-ffmpeg-enc_thread
+fate-ffmpeg-enc_thread: CMD = framecrc -filter_complex "testsrc=d=1:r=5:s=64x48,split[a][b];sine=d=1[c]" -map "[a]" -map "[b]" -map "[c]" -enc_thread_queue_size:v:0 2 -enc_thread_queue_size:a 1 -fflags +bitexact
+
+FATE_FFMPEG-$(call ALLYES, TESTSRC_FILTER SPLIT_FILTER OVERLAY_FILTER SCALE_FILTER) += fate-ffmpeg-filter_thread
+fate-ffmpeg-filter_thread: CMD = framecrc -filter_complex "testsrc=d=1:r=5:s=64x48,split[a][b];[b]scale=32:24[c];[a][c]overlay=8:8" -filter_thread_queue_size 2 -sws_flags +accurate_rnd+bitexact -fflags +bitexact
+
+# decoded input frames through a threaded simple and complex graph, the
+# input size changes halfway through and forces a reinit of the graph
+FATE_FFMPEG_FILTER_THREAD_INPUT = fate-ffmpeg-filter_thread-simple fate-ffmpeg-filter_thread-simple-queue \
+                                  fate-ffmpeg-filter_thread-complex fate-ffmpeg-filter_thread-complex-queue
+$(FATE_FFMPEG_FILTER_THREAD_INPUT): tests/data/ffmpeg-reinit.ppm
+FATE_FFMPEG-$(call ALLYES, IMAGE2PIPE_DEMUXER PNM_PARSER PPM_DECODER IMAGE2PIPE_MUXER PPM_ENCODER \
+                           SPLIT_FILTER OVERLAY_FILTER SCALE_FILTER) += $(FATE_FFMPEG_FILTER_THREAD_INPUT)
+fate-ffmpeg-filter_thread-simple: CMD = framecrc -f image2pipe -c:v ppm -i $(TARGET_PATH)/tests/data/ffmpeg-reinit.ppm -vf scale=32:24 -pix_fmt rgb24 -sws_flags +accurate_rnd+bitexact
+fate-ffmpeg-filter_thread-simple-queue: CMD = framecrc -f image2pipe -c:v ppm -i $(TARGET_PATH)/tests/data/ffmpeg-reinit.ppm -vf scale=32:24 -pix_fmt rgb24 -sws_flags +accurate_rnd+bitexact -filter_thread_queue_size 1
+fate-ffmpeg-filter_thread-simple-queue: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-filter_thread-simple
+fate-ffmpeg-filter_thread-complex: CMD = framecrc -f image2pipe -c:v ppm -i $(TARGET_PATH)/tests/data/ffmpeg-reinit.ppm -filter_complex "[0:v]scale=64:48,split[a][b];[b]scale=32:24[c];[a][c]overlay=8:8" -pix_fmt rgb24 -sws_flags +accurate_rnd+bitexact
+fate-ffmpeg-filter_thread-complex-queue: CMD = framecrc -f image2pipe -c:v ppm -i $(TARGET_PATH)/tests/data/ffmpeg-reinit.ppm -filter_complex "[0:v]scale=64:48,split[a][b];[b]scale=32:24[c];[a][c]overlay=8:8" -pix_fmt rgb24 -sws_flags +accurate_rnd+bitexact -filter_thread_queue_size 1
+fate-ffmpeg-filter_thread-complex-queue: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-filter_thread-complex
+
+FATE_FFMPEG-$(call ALLYES, WAV_DEMUXER PCM_S16LE_DECODER ANULL_FILTER PCM_S16LE_ENCODER NULL_MUXER) += fate-ffmpeg-benchmark_stages
+fate-ffmpeg-benchmark_stages: tests/data/asynth-8000-1.wav
+fate-ffmpeg-benchmark_stages: CMD = benchmark_stages -i $(TARGET_PATH)/tests/data/asynth-8000-1.wav -af anull -c:a pcm_s16le
+
+FATE_FFMPEG-$(call DEMMUX, WAV, FRAMECRC) += fate-ffmpeg-stream_loop-wav
+fate-ffmpeg-stream_loop-wav: tests/data/asynth-8000-1.wav
+fate-ffmpeg-stream_loop-wav: CMD = framecrc -stream_loop 1 -ss 1 -i $(TARGET_PATH)/tests/data/asynth-8000-1.wav -c copy
+
+# the input is read ahead in blocks smaller than the file, the seek to 1s
+# skips forward and looping seeks back to the start
+FATE_FFMPEG-$(call DEMMUX, WAV, FRAMECRC) += fate-ffmpeg-file-readahead
+fate-ffmpeg-file-readahead: tests/data/asynth-8000-1.wav
+fate-ffmpeg-file-readahead: CMD = framecrc -stream_loop 1 -ss 1 -readahead_depth 3 -readahead_block_size 4096 -i $(TARGET_PATH)/tests/data/asynth-8000-1.wav -c copy
+fate-ffmpeg-file-readahead: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-stream_loop-wav
+
 FATE_SAMPLES_FFMPEG-$(CONFIG_RAWVIDEO_DEMUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
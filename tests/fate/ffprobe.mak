@@ -29,6 +29,16 @@ FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_xml
 fate-ffprobe_xml: $(FFPROBE_TEST_FILE)
 fate-ffprobe_xml: CMD = run $(FFPROBE_COMMAND) -of xml
 
+FFPROBE_BATCH_LIST=tests/data/ffprobe-batch.list
+$(FFPROBE_BATCH_LIST): TAG = GEN
+$(FFPROBE_BATCH_LIST): $(FFPROBE_TEST_FILE)
+	$(M)printf "%s\n" $(TARGET_PATH)/$(FFPROBE_TEST_FILE) $(TARGET_PATH)/$(FFPROBE_TEST_FILE) > $@
+
+FATE_FFPROBE_BATCH-$(HAVE_THREADS) += fate-ffprobe_batch
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += $(FATE_FFPROBE_BATCH-yes)
+fate-ffprobe_batch: $(FFPROBE_BATCH_LIST)
+fate-ffprobe_batch: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -batch $(TARGET_PATH)/$(FFPROBE_BATCH_LIST) -batch_threads 2 -show_entries format=nb_streams,format_name:stream=index,codec_name -bitexact -of compact
+
 FATE_FFPROBE += $(FATE_FFPROBE-yes)
 
 fate-ffprobe: $(FATE_FFPROBE)
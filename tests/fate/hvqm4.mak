@@ -0,0 +1,66 @@
+# The samples are generated by tests/hvqm4gen. Their video payloads are
+# random, so only the container and the audio can be checked here.
+
+FATE_HVQM4-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-demux-1.3
+fate-hvqm4-demux-1.3: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-demux-1.3: CMD = framecrc -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m -c copy
+
+FATE_HVQM4-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-demux-1.5
+fate-hvqm4-demux-1.5: tests/data/hvqm4-1.5.h4m
+fate-hvqm4-demux-1.5: CMD = framecrc -i $(TARGET_PATH)/tests/data/hvqm4-1.5.h4m -c copy
+
+FATE_HVQM4-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-demux-readahead
+fate-hvqm4-demux-readahead: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-demux-readahead: CMD = framecrc -gop_readahead 1 -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m -c copy
+
+FATE_HVQM4-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-demux-ss
+fate-hvqm4-demux-ss: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-demux-ss: CMD = framecrc -ss 0.5 -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m -c copy
+
+FATE_HVQM4-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-seek
+fate-hvqm4-seek: tests/data/hvqm4-1.3.h4m libavformat/tests/seek$(EXESUF)
+fate-hvqm4-seek: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m
+
+FATE_HVQM4-$(call DEMMUX, HVQM4, HVQM4) += fate-hvqm4-remux
+fate-hvqm4-remux: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-remux: CMD = transcode hvqm4 $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m hvqm4 "-c copy" "-c copy"
+
+# the file header totals cannot be written to a pipe, the demuxer has
+# to find the GOPs without them
+FATE_HVQM4-$(call DEMMUX, HVQM4, HVQM4) += fate-hvqm4-remux-pipe
+fate-hvqm4-remux-pipe: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-remux-pipe: CMD = pipe_remux hvqm4 $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m hvqm4
+fate-hvqm4-remux-pipe: REF = $(SRC_PATH)/tests/ref/fate/hvqm4-demux-1.3
+
+FATE_HVQM4-$(call DEMDEC, HVQM4, ADPCM_IMA_HVQM4) += fate-hvqm4-adpcm
+fate-hvqm4-adpcm: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-adpcm: CMD = framecrc -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m -map 0:a
+
+FATE_HVQM4_FFPROBE-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-frame-info
+fate-hvqm4-frame-info: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-frame-info: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -v 0 -export_frame_info 1 -show_entries packet=stream_index,pts,dts,duration,pos,flags:packet_tags -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m
+
+# raw frame records, split by the parser or by hvqm4_split, must give the
+# same video packets as the demuxer
+FATE_HVQM4-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-video-data
+fate-hvqm4-video-data: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-video-data: CMD = md5 -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m -map 0:v -c copy -f rawvideo
+
+FATE_HVQM4-$(call ALLYES, HVQM4RAW_DEMUXER HVQM4_SPLIT_BSF) += fate-hvqm4-raw-split
+fate-hvqm4-raw-split: tests/data/hvqm4-raw.bin
+fate-hvqm4-raw-split: CMD = md5 -f hvqm4raw -video_size 64x48 -fflags +noparse+nofillin -raw_packet_size 1000000 -i $(TARGET_PATH)/tests/data/hvqm4-raw.bin -c copy -copyinkf -bsf:v hvqm4_split -f rawvideo
+fate-hvqm4-raw-split: REF = $(SRC_PATH)/tests/ref/fate/hvqm4-video-data
+
+FATE_HVQM4_FFPROBE-$(CONFIG_HVQM4_DEMUXER) += fate-hvqm4-video-packets
+fate-hvqm4-video-packets: tests/data/hvqm4-1.3.h4m
+fate-hvqm4-video-packets: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -v 0 -select_streams v -show_data_hash crc32 -show_entries packet=size,flags,data_hash -i $(TARGET_PATH)/tests/data/hvqm4-1.3.h4m
+
+# small reads, so that records straddle the parser input
+FATE_HVQM4_FFPROBE-$(CONFIG_HVQM4RAW_DEMUXER) += fate-hvqm4-raw-parser
+fate-hvqm4-raw-parser: tests/data/hvqm4-raw.bin
+fate-hvqm4-raw-parser: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -v 0 -f hvqm4raw -video_size 64x48 -raw_packet_size 100 -show_data_hash crc32 -show_entries packet=size,flags,data_hash -i $(TARGET_PATH)/tests/data/hvqm4-raw.bin
+fate-hvqm4-raw-parser: REF = $(SRC_PATH)/tests/ref/fate/hvqm4-video-packets
+
+FATE_FFMPEG += $(FATE_HVQM4-yes)
+FATE_FFPROBE += $(FATE_HVQM4_FFPROBE-yes)
+fate-hvqm4: $(FATE_HVQM4-yes) $(FATE_HVQM4_FFPROBE-yes)
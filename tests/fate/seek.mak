@@ -265,12 +265,26 @@ fate-seek-mkv-codec-delay:   CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_
 
 FATE_SEEK_EXTRA += $(FATE_SEEK_EXTRA-yes)
 
+# generated files
 
-$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA): libavformat/tests/seek$(EXESUF)
+FATE_SEEK_DATA-$(CONFIG_WAV_DEMUXER) += fate-seek-wav
+FATE_SEEK_DATA-$(CONFIG_WAV_DEMUXER) += fate-seek-wav-file-readahead
+
+fate-seek-wav fate-seek-wav-file-readahead: tests/data/asynth-8000-1.wav
+fate-seek-wav: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/asynth-8000-1.wav
+# file protocol read-ahead in blocks smaller than the file, by fewer
+# threads than blocks
+fate-seek-wav-file-readahead: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/asynth-8000-1.wav -readahead_depth 3 -readahead_block_size 4096 -readahead_threads 2
+fate-seek-wav-file-readahead: REF = $(SRC_PATH)/tests/ref/seek/wav
+
+FATE_SEEK_DATA += $(FATE_SEEK_DATA-yes)
+
+
+$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_DATA): libavformat/tests/seek$(EXESUF)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/$(SRC)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_DATA)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
 fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
@@ -0,0 +1,216 @@
+/*
+ * Generate a synthetic HVQM4 file.
+ * The video payloads are random and only meant for testing the container,
+ * the audio is random 4 bit IMA ADPCM which decodes to noise.
+ * The "raw" version only contains the frame records, without the file and
+ * GOP headers.
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WIDTH           64
+#define HEIGHT          48
+#define FRAME_USEC      33367
+#define SAMPLE_RATE     22050
+#define CHANNELS        2
+#define NB_GOPS         6
+#define AUDIO_SAMPLES   735
+#define MAX_GOP_SIZE    (1 << 16)
+
+/* frame type and display order within the GOP, in decoding order */
+static const struct {
+    int type, disp_id;
+} gop_frames[] = {
+    { 0x10, 0 }, { 0x20, 3 }, { 0x30, 1 }, { 0x30, 2 },
+    { 0x20, 6 }, { 0x30, 4 }, { 0x30, 5 },
+};
+
+#define GOP_FRAMES (sizeof(gop_frames) / sizeof(gop_frames[0]))
+
+static unsigned int myrnd(unsigned int *seed_ptr, int n)
+{
+    unsigned int seed, val;
+
+    seed = *seed_ptr;
+    seed = (seed * 314159) + 1;
+    if (n == 256) {
+        val = seed >> 24;
+    } else {
+        val = seed % n;
+    }
+    *seed_ptr = seed;
+    return val;
+}
+
+static uint8_t *put_be16(uint8_t *p, unsigned v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+    return p + 2;
+}
+
+static uint8_t *put_be32(uint8_t *p, unsigned v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static uint8_t *put_random(uint8_t *p, int size, unsigned int *seed)
+{
+    while (size--)
+        *p++ = myrnd(seed, 256);
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t gop[MAX_GOP_SIZE];
+    uint8_t header[0x44] = { 0 }, *p;
+    unsigned int seed = 1;
+    unsigned prev_size = 0, body_size = 0, max_video_size = 0, max_audio_size = 0;
+    unsigned nb_video = 0, nb_audio = 0;
+    const char *version;
+    FILE *outfile;
+    int raw;
+    int i, j, ch;
+
+    if (argc != 3) {
+        printf("usage: %s file version\n"
+               "generate a synthetic HVQM4 file, version is 1.3, 1.5 or raw\n",
+               argv[0]);
+        return 1;
+    }
+    version = argv[2];
+    raw = !strcmp(version, "raw");
+    if (!raw && strcmp(version, "1.3") && strcmp(version, "1.5")) {
+        fprintf(stderr, "unsupported version %s\n", version);
+        return 1;
+    }
+
+    outfile = fopen(argv[1], "wb");
+    if (!outfile) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    /* the file header is written last, when all sizes are known */
+    if (!raw)
+        fwrite(header, 1, sizeof(header), outfile);
+
+    for (i = 0; i < NB_GOPS; i++) {
+        unsigned gop_video = 0, gop_audio = 0, gop_size;
+
+        p = gop + 20;
+        for (j = 0; j < GOP_FRAMES; j++) {
+            /* one audio frame for every other video frame */
+            if (!(j & 1)) {
+                int format = !i && !j ? 1 : 2;
+                int samples = AUDIO_SAMPLES;
+                int size = 4;
+
+                if (format == 1) {
+                    size    += 2 * CHANNELS;
+                    samples -= 1;
+                }
+                size += (samples * CHANNELS + 1) / 2;
+
+                p = put_be16(p, 0);
+                p = put_be16(p, format);
+                p = put_be32(p, size);
+                p = put_be32(p, AUDIO_SAMPLES);
+                /* predictor and step index */
+                if (format == 1)
+                    for (ch = 0; ch < CHANNELS; ch++)
+                        p = put_be16(p, myrnd(&seed, 512) << 7 | myrnd(&seed, 89));
+                p = put_random(p, (samples * CHANNELS + 1) / 2, &seed);
+                if (size > max_audio_size)
+                    max_audio_size = size;
+                gop_audio++;
+            }
+
+            {
+                int size = 4 + 20 + myrnd(&seed, 180);
+
+                p = put_be16(p, 1);
+                p = put_be16(p, gop_frames[j].type);
+                p = put_be32(p, size);
+                p = put_be32(p, gop_frames[j].disp_id);
+                p = put_random(p, size - 4, &seed);
+                if (size > max_video_size)
+                    max_video_size = size;
+                gop_video++;
+            }
+        }
+
+        gop_size = p - gop;
+        p = put_be32(gop, prev_size);
+        p = put_be32(p, gop_size);
+        p = put_be32(p, gop_video);
+        p = put_be32(p, gop_audio);
+        put_be32(p, 0x01000000);
+        if (raw)
+            fwrite(gop + 20, 1, gop_size - 20, outfile);
+        else
+            fwrite(gop, 1, gop_size, outfile);
+
+        prev_size  = gop_size;
+        body_size += gop_size;
+        nb_video  += gop_video;
+        nb_audio  += gop_audio;
+    }
+
+    if (raw) {
+        fclose(outfile);
+        return 0;
+    }
+
+    memcpy(header, "HVQM4 ", 6);
+    memcpy(header + 6, version, strlen(version));
+    p = put_be32(header + 16, sizeof(header));
+    p = put_be32(p, body_size);
+    p = put_be32(p, NB_GOPS);
+    p = put_be32(p, nb_video);
+    p = put_be32(p, nb_audio);
+    p = put_be32(p, FRAME_USEC);
+    p = put_be32(p, max_video_size);
+    p = put_be32(p, 0);
+    p = put_be32(p, max_audio_size);
+    p = put_be16(p, WIDTH);
+    p = put_be16(p, HEIGHT);
+    *p++ = 2; /* horizontal sampling */
+    *p++ = 2; /* vertical sampling */
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = CHANNELS;
+    *p++ = 4; /* bits per sample */
+    p = put_be16(p, 0);
+    put_be32(p, SAMPLE_RATE);
+
+    fseek(outfile, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), outfile);
+    fclose(outfile);
+
+    return 0;
+}
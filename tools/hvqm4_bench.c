@@ -0,0 +1,224 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Decode the video of an HVQM4 file and report the decoding time per
+ * frame type. With more than one thread, the time is measured from
+ * sending a packet until the next frame is returned, which includes
+ * waiting for other threads.
+ *
+ * With -d, only demux the file and report the number of packets read
+ * per second.
+ */
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/time.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+typedef struct FrameTypeStats {
+    const char *name;
+    int64_t count;
+    int64_t total;
+    int64_t min;
+    int64_t max;
+} FrameTypeStats;
+
+static void usage(int ret)
+{
+    fprintf(ret ? stderr : stdout,
+            "Usage: hvqm4_bench [-d] [-t threads] [-r runs] file\n");
+    exit(ret);
+}
+
+static int frame_type_index(const AVPacket *pkt)
+{
+    if (pkt->size < 2)
+        return 3;
+    switch (AV_RB16(pkt->data)) {
+    case 0x10: return 0;
+    case 0x20: return 1;
+    case 0x30: return 2;
+    }
+    return 3;
+}
+
+static int demux_file(const char *filename, int64_t *nb_packets, int64_t *total)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    AVPacket pkt;
+    int64_t t;
+    int ret;
+
+    if ((ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL)) < 0) {
+        fprintf(stderr, "%s: %s\n", filename, av_err2str(ret));
+        return ret;
+    }
+
+    t = av_gettime_relative();
+    while ((ret = av_read_frame(fmt_ctx, &pkt)) >= 0) {
+        (*nb_packets)++;
+        av_packet_unref(&pkt);
+    }
+    *total += av_gettime_relative() - t;
+
+    avformat_close_input(&fmt_ctx);
+    if (ret != AVERROR_EOF) {
+        fprintf(stderr, "demuxing failed: %s\n", av_err2str(ret));
+        return ret;
+    }
+    return 0;
+}
+
+static int decode_file(const char *filename, int threads, FrameTypeStats *stats)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    AVCodecContext *dec_ctx = NULL;
+    AVFrame *frame = NULL;
+    AVPacket pkt;
+    AVCodec *codec;
+    int stream, ret;
+
+    if ((ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL)) < 0) {
+        fprintf(stderr, "%s: %s\n", filename, av_err2str(ret));
+        return ret;
+    }
+    ret = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (ret < 0) {
+        fprintf(stderr, "%s: no decodable video stream\n", filename);
+        goto end;
+    }
+    stream = ret;
+
+    dec_ctx = avcodec_alloc_context3(codec);
+    frame   = av_frame_alloc();
+    if (!dec_ctx || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = avcodec_parameters_to_context(dec_ctx, fmt_ctx->streams[stream]->codecpar)) < 0)
+        goto end;
+    dec_ctx->thread_count = threads;
+    if ((ret = avcodec_open2(dec_ctx, codec, NULL)) < 0) {
+        fprintf(stderr, "could not open decoder: %s\n", av_err2str(ret));
+        goto end;
+    }
+
+    while ((ret = av_read_frame(fmt_ctx, &pkt)) >= 0) {
+        if (pkt.stream_index == stream) {
+            FrameTypeStats *s = &stats[frame_type_index(&pkt)];
+            int64_t t = av_gettime_relative();
+
+            ret = avcodec_send_packet(dec_ctx, &pkt);
+            while (ret >= 0) {
+                ret = avcodec_receive_frame(dec_ctx, frame);
+                if (ret >= 0)
+                    av_frame_unref(frame);
+            }
+            t = av_gettime_relative() - t;
+
+            s->count++;
+            s->total += t;
+            if (!s->min || t < s->min)
+                s->min = t;
+            s->max = FFMAX(s->max, t);
+        }
+        av_packet_unref(&pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            fprintf(stderr, "decoding failed: %s\n", av_err2str(ret));
+            goto end;
+        }
+    }
+
+    // drain the delayed frames
+    avcodec_send_packet(dec_ctx, NULL);
+    while (avcodec_receive_frame(dec_ctx, frame) >= 0)
+        av_frame_unref(frame);
+    ret = 0;
+
+end:
+    av_frame_free(&frame);
+    avcodec_free_context(&dec_ctx);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    FrameTypeStats stats[4] = {
+        { "I" }, { "P" }, { "B" }, { "other" },
+    };
+    int64_t nb_packets = 0, total = 0;
+    int opt, demux_only = 0, threads = 1, runs = 1, i, ret;
+
+    while ((opt = getopt(argc, argv, "hdt:r:")) != -1) {
+        switch (opt) {
+        case 'd':
+            demux_only = 1;
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'h':
+            usage(0);
+        default:
+            usage(1);
+        }
+    }
+    if (optind + 1 != argc || runs < 1)
+        usage(1);
+
+    if (demux_only) {
+        for (i = 0; i < runs; i++)
+            if ((ret = demux_file(argv[optind], &nb_packets, &total)) < 0)
+                return 1;
+
+        printf("packets    total us   packets/s\n");
+        printf("%7"PRId64" %11"PRId64" %11.0f\n", nb_packets, total,
+               total ? nb_packets * 1000000.0 / total : 0.0);
+        return 0;
+    }
+
+    for (i = 0; i < runs; i++)
+        if ((ret = decode_file(argv[optind], threads, stats)) < 0)
+            return 1;
+
+    printf("type  frames    total us     avg us    min us    max us\n");
+    for (i = 0; i < FF_ARRAY_ELEMS(stats); i++) {
+        const FrameTypeStats *s = &stats[i];
+        if (!s->count)
+            continue;
+        printf("%-5s %6"PRId64" %11"PRId64" %10.2f %9"PRId64" %9"PRId64"\n",
+               s->name, s->count, s->total, (double)s->total / s->count,
+               s->min, s->max);
+    }
+
+    return 0;
+}
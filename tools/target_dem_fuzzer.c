@@ -92,6 +92,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     uint8_t *io_buffer;
     int io_buffer_size = 32768;
     int64_t filesize   = size;
+    int64_t seek_ts    = 0;
     IOContext opaque;
     static int c;
     int seekable = 0;
@@ -116,6 +117,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         io_buffer_size = bytestream2_get_le32(&gbc) & 0xFFFFFFF;
         seekable       = bytestream2_get_byte(&gbc) & 1;
         filesize       = bytestream2_get_le64(&gbc) & 0x7FFFFFFFFFFFFFFF;
+        seek_ts        = bytestream2_get_le64(&gbc);
     }
     io_buffer = av_malloc(io_buffer_size);
     if (!io_buffer)
@@ -144,14 +146,22 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 
     av_init_packet(&pkt);
 
-    //TODO, test seeking
-
     for(it = 0; it < maxiteration; it++) {
         ret = av_read_frame(avfmt, &pkt);
         if (ret < 0)
             break;
         av_packet_unref(&pkt);
     }
+
+    if (seekable && seek_ts) {
+        ret = av_seek_frame(avfmt, -1, seek_ts >> 1, (seek_ts & 1) * AVSEEK_FLAG_BACKWARD);
+        for(it = 0; ret >= 0 && it < maxiteration; it++) {
+            ret = av_read_frame(avfmt, &pkt);
+            if (ret < 0)
+                break;
+            av_packet_unref(&pkt);
+        }
+    }
 end:
     av_freep(&fuzzed_pb->buffer);
     av_freep(&fuzzed_pb);